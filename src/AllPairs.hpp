@@ -0,0 +1,151 @@
+#ifndef DYNRPG_PATHFINDER_ALL_PAIRS_HPP
+#define DYNRPG_PATHFINDER_ALL_PAIRS_HPP
+
+#pragma once
+
+#include "MapSnapshot.hpp"
+#include "WorkerPool.hpp"
+
+#include <atomic>
+#include <chrono>
+
+/* Next step directions between every pair of walkable tiles of the current map. This trades memory (one byte per pair)
+ * for not searching at all, thus it's only built for small maps. The table is built in the background for the hero's
+ * passability class as soon as a new map has been entered; requests are answered by it once it's complete.
+ * The rows are built by the worker pool in chunks, which give way to path jobs. Without workers, they are built on the
+ * game thread as long as the frame budget allows. */
+class AllPairsTable
+{
+public:
+	~AllPairsTable()
+	{
+		stop();
+	}
+
+	// has to be called each frame; starts a new build when the hero's static layer has been replaced
+	void update(std::size_t _maxTiles, std::size_t _maxBytes, std::chrono::microseconds _budget)
+	{
+		if (_maxTiles == 0)
+			return;
+
+		auto layer = globalSnapshotProvider.get_layer(*RPG::hero);
+		if (layer != m_Layer)
+			_start(std::move(layer), _maxTiles, _maxBytes);
+
+		if (m_Build && !m_Build->ready.load(std::memory_order_acquire) && !globalWorkerPool.is_running())
+		{
+			auto deadline = std::chrono::steady_clock::now() + _budget;
+			while (_build_rows(*m_Build, 1) && std::chrono::steady_clock::now() < deadline)
+				;
+		}
+	}
+
+	// cancels a running build and forgets the table; chunks which are already running hold their own reference
+	void stop()
+	{
+		if (m_Build)
+			m_Build->cancel = true;
+		m_Build.reset();
+		m_Layer.reset();
+	}
+
+	std::optional<Path> find_path(RPG::Character& _character, const Vector& _start, const Vector& _end)
+	{
+		if (!m_Build || !m_Build->ready.load(std::memory_order_acquire))
+			return std::nullopt;
+
+		auto snapshot = globalSnapshotProvider.get(_character);
+		if (snapshot->layer() != m_Layer || !snapshot->is_valid_pos(_end))
+			return std::nullopt;
+
+		auto& data = *m_Build;
+		auto target = data.indices[snapshot->to_index(_end)];
+		if (target < 0)
+			return std::nullopt;
+
+		auto count = std::size(data.tiles);
+		return walk_next_dirs(*snapshot,
+			[&data, target, count](int _index)
+			{
+				auto source = data.indices[_index];
+				return source < 0 ? -1 : data.nextDirs[target * count + source];
+			},
+			_start, _end
+		);
+	}
+
+private:
+	static constexpr std::size_t chunkRows = 16;
+
+	struct Build
+	{
+		std::shared_ptr<const StaticMapLayer> layer;
+		std::vector<int> indices;				// tile index -> walkable index; -1 if not walkable
+		std::vector<int> tiles;					// walkable index -> tile index
+		std::vector<std::int8_t> nextDirs;		// one row per target
+		std::atomic<std::size_t> nextRow{ 0 };
+		std::atomic<std::size_t> finishedRows{ 0 };
+		std::atomic<bool> cancel{ false };
+		std::atomic<bool> ready{ false };
+	};
+
+	std::shared_ptr<const StaticMapLayer> m_Layer;
+	std::shared_ptr<Build> m_Build;
+
+	void _start(std::shared_ptr<const StaticMapLayer> _layer, std::size_t _maxTiles, std::size_t _maxBytes)
+	{
+		stop();
+		m_Layer = _layer;
+
+		auto build = std::make_shared<Build>();
+		build->layer = std::move(_layer);
+		build->indices.resize(std::size(build->layer->passable), -1);
+		for (std::size_t i = 0; i < std::size(build->layer->passable); ++i)
+		{
+			if (build->layer->passable[i] != 0)
+			{
+				build->indices[i] = static_cast<int>(std::size(build->tiles));
+				build->tiles.emplace_back(static_cast<int>(i));
+			}
+		}
+
+		auto count = std::size(build->tiles);
+		if (count == 0 || _maxTiles < count || _maxBytes / count < count)
+			return;
+
+		build->nextDirs.resize(count * count, -1);
+		m_Build = build;
+		if (globalWorkerPool.is_running())
+		{
+			for (std::size_t i = 0; i < count; i += chunkRows)
+				globalWorkerPool.post([build] { _build_rows(*build, chunkRows); });
+		}
+	}
+
+	/* Rows are claimed by whoever comes first, thus the game thread and the workers never build the same row. The one
+	 * which finishes the last row publishes the table. Returns false as soon as nothing is left to claim. */
+	static bool _build_rows(Build& _build, std::size_t _rows)
+	{
+		MapSnapshot snapshot{ 0, _build.layer, nullptr };
+		auto count = std::size(_build.tiles);
+		for (std::size_t i = 0; i < _rows; ++i)
+		{
+			auto target = _build.nextRow.fetch_add(1, std::memory_order_relaxed);
+			if (count <= target || _build.cancel)
+				return false;
+
+			auto tree = build_shortest_path_tree(snapshot, snapshot.to_vector(_build.tiles[target]));
+			auto row = std::begin(_build.nextDirs) + target * count;
+			for (std::size_t source = 0; source < count; ++source)
+				row[source] = tree[_build.tiles[source]];
+
+			if (_build.finishedRows.fetch_add(1, std::memory_order_acq_rel) + 1 == count && !_build.cancel)
+				_build.ready.store(true, std::memory_order_release);
+		}
+		return true;
+	}
+};
+
+inline static AllPairsTable globalAllPairs;
+
+#endif
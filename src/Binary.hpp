@@ -0,0 +1,124 @@
+#ifndef DYNRPG_PATHFINDER_BINARY_HPP
+#define DYNRPG_PATHFINDER_BINARY_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Little-endian encoding of the save data, independent of the platform. Everything is appended to one buffer, which is
+ * handed over to DynRPG as a whole. */
+class BinaryWriter
+{
+public:
+	void write_u8(std::uint8_t _value)
+	{
+		m_Buffer.emplace_back(static_cast<char>(_value));
+	}
+
+	void write_u32(std::uint32_t _value)
+	{
+		for (int i = 0; i < 4; ++i)
+			write_u8(static_cast<std::uint8_t>(_value >> (i * 8)));
+	}
+
+	void write_i32(std::int32_t _value)
+	{
+		write_u32(static_cast<std::uint32_t>(_value));
+	}
+
+	void write_bytes(const void* _data, std::size_t _size)
+	{
+		auto data = static_cast<const char*>(_data);
+		m_Buffer.insert(std::end(m_Buffer), data, data + _size);
+	}
+
+	const std::vector<char>& buffer() const
+	{
+		return m_Buffer;
+	}
+
+private:
+	std::vector<char> m_Buffer;
+};
+
+// reads directly from the buffer; as soon as the data ends too early, every further read fails, too
+class BinaryReader
+{
+public:
+	BinaryReader(const char* _data, std::size_t _size) :
+		m_Data{ _data },
+		m_Size{ _size }
+	{
+	}
+
+	bool read_u8(std::uint8_t& _value)
+	{
+		if (!_require(1))
+			return false;
+		_value = static_cast<std::uint8_t>(m_Data[m_Pos++]);
+		return true;
+	}
+
+	bool read_u32(std::uint32_t& _value)
+	{
+		if (!_require(4))
+			return false;
+		_value = 0;
+		for (int i = 0; i < 4; ++i)
+			_value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(m_Data[m_Pos++])) << (i * 8);
+		return true;
+	}
+
+	bool read_i32(std::int32_t& _value)
+	{
+		std::uint32_t value = 0;
+		if (!read_u32(value))
+			return false;
+		_value = static_cast<std::int32_t>(value);
+		return true;
+	}
+
+	bool read_bytes(void* _data, std::size_t _size)
+	{
+		if (!_require(_size))
+			return false;
+		std::memcpy(_data, m_Data + m_Pos, _size);
+		m_Pos += _size;
+		return true;
+	}
+
+	// element counts are checked against the remaining data, thus broken saves won't cause huge allocations
+	bool read_count(std::uint32_t& _count, std::size_t _minElementSize)
+	{
+		if (read_u32(_count) && remaining() / (_minElementSize ? _minElementSize : 1) < _count)
+			m_Failed = true;
+		return !m_Failed;
+	}
+
+	std::size_t remaining() const
+	{
+		return m_Failed ? 0 : m_Size - m_Pos;
+	}
+
+	bool failed() const
+	{
+		return m_Failed;
+	}
+
+private:
+	const char* m_Data;
+	std::size_t m_Size;
+	std::size_t m_Pos = 0;
+	bool m_Failed = false;
+
+	bool _require(std::size_t _size)
+	{
+		if (m_Failed || m_Size - m_Pos < _size)
+			m_Failed = true;
+		return !m_Failed;
+	}
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef DYNRPG_PATHFINDER_COMPACT_PATH_HPP
+#define DYNRPG_PATHFINDER_COMPACT_PATH_HPP
+
+#pragma once
+
+#include "Binary.hpp"
+#include "Vector.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/* Stores a path as its start vertex followed by one direction code per step; 2 bits per code for paths with straight
+ * steps only, 3 bits if any diagonal step is part of it. Straight runs are compressed: Because paths never turn back
+ * immediately, the code of the opposite direction is free to be used as escape. It's followed by a 4 bit payload,
+ * which either repeats the previous direction several times or (payload 15) really turns back. */
+class CompactPath
+{
+public:
+	struct Cursor
+	{
+		std::size_t index = 0;		// index of the current vertex
+		std::size_t bitPos = 0;		// position of the next code
+		Vector at;
+		int dir = -1;				// direction of the last step
+		int repeats = 0;			// remaining steps of the current run
+	};
+
+	CompactPath() = default;
+
+	explicit CompactPath(const std::vector<Vector>& _vertices)
+	{
+		if (std::empty(_vertices))
+			return;
+
+		m_Start = _vertices.front();
+		m_Size = std::size(_vertices);
+
+		std::vector<int> dirs;
+		dirs.reserve(m_Size - 1);
+		for (std::size_t i = 1; i < m_Size; ++i)
+		{
+			auto dir = direction_of(_vertices[i] - _vertices[i - 1]);
+			assert(0 <= dir && "vertices must be adjacent");
+			dirs.emplace_back(dir);
+			if (4 <= dir)
+				m_CodeBits = 3;
+		}
+		_encode(dirs);
+	}
+
+	std::size_t size() const
+	{
+		return m_Size;
+	}
+
+	bool empty() const
+	{
+		return m_Size == 0;
+	}
+
+	const Vector& start() const
+	{
+		return m_Start;
+	}
+
+	std::size_t memory_size() const
+	{
+		return sizeof(CompactPath) + m_Bits.capacity();
+	}
+
+	Cursor begin() const
+	{
+		Cursor cursor;
+		cursor.at = m_Start;
+		return cursor;
+	}
+
+	// moves the cursor onto the next vertex; returns false if it already points to the last one
+	bool advance(Cursor& _cursor) const
+	{
+		if (m_Size <= _cursor.index + 1)
+			return false;
+
+		if (0 < _cursor.repeats)
+			--_cursor.repeats;
+		else
+		{
+			auto code = _read(_cursor.bitPos, m_CodeBits);
+			if (0 <= _cursor.dir && code == opposite_direction(_cursor.dir))
+			{
+				auto payload = _read(_cursor.bitPos, payloadBits);
+				if (payload == turnBackPayload)
+					_cursor.dir = code;
+				else
+					_cursor.repeats = payload + minRun - 1;
+			}
+			else
+				_cursor.dir = code;
+		}
+		_cursor.at += directionOffsets[_cursor.dir];
+		++_cursor.index;
+		return true;
+	}
+
+	// the cursor is only rewound if the index lies behind it, thus sequential access is cheap
+	std::optional<Vector> vertex(std::size_t _index, Cursor& _cursor) const
+	{
+		if (m_Size <= _index)
+			return std::nullopt;
+
+		if (_index < _cursor.index)
+			_cursor = begin();
+		while (_cursor.index < _index)
+			advance(_cursor);
+		return _cursor.at;
+	}
+
+	std::vector<Vector> decode() const
+	{
+		std::vector<Vector> vertices;
+		if (empty())
+			return vertices;
+
+		vertices.reserve(m_Size);
+		auto cursor = begin();
+		vertices.emplace_back(cursor.at);
+		while (advance(cursor))
+			vertices.emplace_back(cursor.at);
+		return vertices;
+	}
+
+	void write(BinaryWriter& _writer) const
+	{
+		_writer.write_u32(static_cast<std::uint32_t>(m_Size));
+		_writer.write_i32(m_Start.x);
+		_writer.write_i32(m_Start.y);
+		_writer.write_u8(static_cast<std::uint8_t>(m_CodeBits));
+		_writer.write_u32(static_cast<std::uint32_t>(std::size(m_Bits)));
+		_writer.write_bytes(m_Bits.data(), std::size(m_Bits));
+	}
+
+	static std::optional<CompactPath> read(BinaryReader& _reader)
+	{
+		CompactPath path;
+		std::uint32_t size = 0;
+		std::uint8_t codeBits = 0;
+		std::uint32_t byteCount = 0;
+		if (!_reader.read_u32(size) || !_reader.read_i32(path.m_Start.x) || !_reader.read_i32(path.m_Start.y) ||
+			!_reader.read_u8(codeBits) || (codeBits != 2 && codeBits != 3) || !_reader.read_count(byteCount, 1))
+			return std::nullopt;
+
+		// the densest encoding is a run of maxRun steps per escape code
+		if (size == 0 ? byteCount != 0 : (static_cast<std::size_t>(byteCount) * 8 / (codeBits + payloadBits) + 1) * maxRun < size - 1)
+			return std::nullopt;
+
+		path.m_Size = size;
+		path.m_CodeBits = codeBits;
+		path.m_Bits.resize(byteCount);
+		if (!_reader.read_bytes(path.m_Bits.data(), byteCount))
+			return std::nullopt;
+		return path;
+	}
+
+private:
+	static constexpr int payloadBits = 4;
+	static constexpr int turnBackPayload = 15;
+	static constexpr int minRun = 4;		// shorter runs are cheaper without escape
+	static constexpr int maxRun = minRun + turnBackPayload - 1;
+
+	Vector m_Start;
+	std::size_t m_Size = 0;
+	int m_CodeBits = 2;
+	std::vector<std::uint8_t> m_Bits;
+
+	void _encode(const std::vector<int>& _dirs)
+	{
+		std::size_t bitPos = 0;
+		int prevDir = -1;
+		for (std::size_t i = 0; i < std::size(_dirs); )
+		{
+			auto dir = _dirs[i];
+			if (0 <= prevDir && dir == opposite_direction(prevDir))
+			{
+				_write(bitPos, m_CodeBits, dir);
+				_write(bitPos, payloadBits, turnBackPayload);
+				prevDir = dir;
+				++i;
+				continue;
+			}
+
+			if (dir == prevDir)
+			{
+				std::size_t run = 1;
+				while (i + run < std::size(_dirs) && _dirs[i + run] == dir && run < maxRun)
+					++run;
+				if (minRun <= run)
+				{
+					_write(bitPos, m_CodeBits, opposite_direction(dir));
+					_write(bitPos, payloadBits, static_cast<int>(run) - minRun);
+					i += run;
+					continue;
+				}
+			}
+
+			_write(bitPos, m_CodeBits, dir);
+			prevDir = dir;
+			++i;
+		}
+		m_Bits.shrink_to_fit();
+	}
+
+	void _write(std::size_t& _bitPos, int _bitCount, int _value)
+	{
+		for (int i = 0; i < _bitCount; ++i, ++_bitPos)
+		{
+			if (std::size(m_Bits) * 8 <= _bitPos)
+				m_Bits.emplace_back(0);
+			if (_value & (1 << i))
+				m_Bits[_bitPos / 8] |= static_cast<std::uint8_t>(1 << (_bitPos % 8));
+		}
+	}
+
+	int _read(std::size_t& _bitPos, int _bitCount) const
+	{
+		// bits behind the end are read as 0, thus broken save data can't lead to out of bounds reads
+		int value = 0;
+		for (int i = 0; i < _bitCount; ++i, ++_bitPos)
+		{
+			if (_bitPos / 8 < std::size(m_Bits) && m_Bits[_bitPos / 8] & (1 << (_bitPos % 8)))
+				value |= 1 << i;
+		}
+		return value;
+	}
+};
+
+#endif
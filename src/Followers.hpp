@@ -0,0 +1,149 @@
+#ifndef DYNRPG_PATHFINDER_FOLLOWERS_HPP
+#define DYNRPG_PATHFINDER_FOLLOWERS_HPP
+
+#pragma once
+
+#include "MapSnapshot.hpp"
+
+/* Characters which walk along a path on their own. The next step is issued as soon as a follower has rested as long as its
+ * movement frequency demands, as long as it isn't blocked on the current snapshot. Blocked followers wait and try to find
+ * a detour from time to time. */
+class PathFollowers
+{
+public:
+	// replaces the current path of the character; fails if the path doesn't start at the character's position
+	bool attach(RPG::Character& _character, int _pathId, int _finishedSwitch)
+	{
+		_sync_map_epoch();
+		detach(_character);
+		auto path = globalPathMgr.share_path(_pathId);
+		if (!path || std::size(*path) < 2 || path->start() != Vector{ _character.x, _character.y })
+			return false;
+
+		auto cursor = path->begin();
+		m_Followers.emplace_back(Follower{ &_character, _pathId, std::move(path), cursor, _finishedSwitch, 0, 0 });
+		_set_switch(_finishedSwitch, false);
+		return true;
+	}
+
+	void detach(RPG::Character& _character)
+	{
+		m_Followers.erase(
+			std::remove_if(std::begin(m_Followers), std::end(m_Followers),
+				[&_character](const Follower& _follower) { return _follower.character == &_character; }
+			),
+			std::end(m_Followers)
+		);
+	}
+
+	void update()
+	{
+		_sync_map_epoch();
+		m_Followers.erase(
+			std::remove_if(std::begin(m_Followers), std::end(m_Followers), [](Follower& _follower) { return !_step(_follower); }),
+			std::end(m_Followers)
+		);
+	}
+
+private:
+	static constexpr int replanDelay = 15;			// frames between two replans of the same follower
+	static constexpr std::size_t replanWindow = 8;	// vertices in which a detour has to rejoin the path
+
+	struct Follower
+	{
+		RPG::Character* character;
+		int pathId;
+		PathPtr path;		// may differ from the path behind the ID after a replan
+		CompactPath::Cursor cursor;		// the last vertex the character has reached
+		int finishedSwitch;
+		int nextReplanFrame;
+		int nextStepFrame;
+	};
+
+	std::vector<Follower> m_Followers;
+	unsigned int m_MapEpoch = 0;
+
+	// followers refer to characters of the map they have been attached on
+	void _sync_map_epoch()
+	{
+		if (m_MapEpoch != update_map_epoch())
+		{
+			m_MapEpoch = globalMapEpoch;
+			m_Followers.clear();
+		}
+	}
+
+	static void _set_switch(int _index, bool _value)
+	{
+		if (0 < _index)
+			RPG::system->switches[_index] = _value;
+	}
+
+	// frames a character rests between two steps; the same pauses move routes make at frequencies below 8
+	static int _rest_frames(int _frequency)
+	{
+		return _frequency < 8 ? 1 << (9 - std::max(_frequency, 1)) : 0;
+	}
+
+	// returns false when the follower has reached its destination
+	static bool _step(Follower& _follower)
+	{
+		auto& character = *_follower.character;
+		auto frame = RPG::system->frameCounter;
+		if (0 < character.movementFramesLeft)
+		{
+			// the rest starts with the last frame of the step
+			_follower.nextStepFrame = frame + _rest_frames(character.frequency);
+			return true;
+		}
+
+		Vector pos{ character.x, character.y };
+		auto next = _follower.cursor;
+		if (_follower.path->advance(next) && next.at == pos)
+			_follower.cursor = next;
+
+		if (std::size(*_follower.path) <= _follower.cursor.index + 1)
+		{
+			globalPathMgr.complete_path(_follower.pathId);
+			_set_switch(_follower.finishedSwitch, true);
+			return false;
+		}
+
+		if (frame < _follower.nextStepFrame)
+			return true;
+
+		auto snapshot = globalSnapshotProvider.get(character);
+		next = _follower.cursor;
+		_follower.path->advance(next);
+		auto index = snapshot->to_index(_follower.cursor.at);
+		bool blocked = !snapshot->is_valid_pos(next.at) || snapshot->is_blocked(snapshot->to_index(next.at)) ||
+			(next.dir < 4 && !snapshot->can_move(index, next.dir));
+
+		// the character has been moved by somebody else or has to walk around something
+		if (pos != _follower.cursor.at || blocked)
+		{
+			if (frame < _follower.nextReplanFrame)
+				return true;
+			_follower.nextReplanFrame = frame + replanDelay;
+
+			if (auto path = repair_path(*snapshot, *_follower.path, _follower.cursor.index, pos, replanWindow))
+			{
+				_follower.path = std::make_shared<const CompactPath>(*path);
+				_follower.cursor = _follower.path->begin();
+				if (std::size(*_follower.path) < 2)
+					return true;
+				next = _follower.cursor;
+				_follower.path->advance(next);
+			}
+			else
+				return true;
+		}
+
+		character.doStep(static_cast<RPG::Direction>(next.dir));
+		return true;
+	}
+};
+
+inline static PathFollowers globalFollowers;
+
+#endif
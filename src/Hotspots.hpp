@@ -0,0 +1,95 @@
+#ifndef DYNRPG_PATHFINDER_HOTSPOTS_HPP
+#define DYNRPG_PATHFINDER_HOTSPOTS_HPP
+
+#pragma once
+
+#include "MapSnapshot.hpp"
+
+/* Frequently used destinations (shops, doors, ...) may be registered as hotspots. For each of them a shortest path tree
+ * will be kept, thus paths towards them are just a walk along the tree. Trees are built per passability class and rebuilt
+ * lazily as soon as their static layer has been replaced (i.e. the costs or the map changed). */
+class HotspotRegistry
+{
+public:
+	void register_hotspot(int _mapId, const Vector& _at)
+	{
+		if (_find(_mapId, _at) == std::end(m_Hotspots))
+			m_Hotspots.emplace_back(Hotspot{ _mapId, _at, {} });
+	}
+
+	void unregister_hotspot(int _mapId, const Vector& _at)
+	{
+		if (auto itr = _find(_mapId, _at); itr != std::end(m_Hotspots))
+			m_Hotspots.erase(itr);
+	}
+
+	// builds the tree immediately, instead of waiting for the first request
+	void prepare(RPG::Character& _character, const Vector& _at)
+	{
+		if (auto itr = _find(RPG::Map::properties->id, _at); itr != std::end(m_Hotspots))
+			_get_tree(*itr, globalSnapshotProvider.get_layer(_character));
+	}
+
+	std::optional<Path> find_path(RPG::Character& _character, const Vector& _start, const Vector& _end)
+	{
+		auto itr = _find(RPG::Map::properties->id, _end);
+		if (itr == std::end(m_Hotspots))
+			return std::nullopt;
+
+		auto snapshot = globalSnapshotProvider.get(_character);
+		return walk_shortest_path_tree(*snapshot, _get_tree(*itr, snapshot->layer()), _start, _end);
+	}
+
+	void clear()
+	{
+		m_Hotspots.clear();
+	}
+
+private:
+	struct Tree
+	{
+		std::shared_ptr<const StaticMapLayer> layer;
+		std::vector<std::int8_t> nextDirs;
+	};
+
+	struct Hotspot
+	{
+		int mapId;
+		Vector at;
+		std::vector<Tree> trees;
+	};
+
+	std::vector<Hotspot> m_Hotspots;
+
+	std::vector<Hotspot>::iterator _find(int _mapId, const Vector& _at)
+	{
+		return std::find_if(std::begin(m_Hotspots), std::end(m_Hotspots),
+			[_mapId, &_at](const Hotspot& _hotspot) { return _hotspot.mapId == _mapId && _hotspot.at == _at; }
+		);
+	}
+
+	static const std::vector<std::int8_t>& _get_tree(Hotspot& _hotspot, const std::shared_ptr<const StaticMapLayer>& _layer)
+	{
+		// trees of replaced layers are outdated anyway
+		auto& trees = _hotspot.trees;
+		trees.erase(
+			std::remove_if(std::begin(trees), std::end(trees),
+				[&_layer](const Tree& _tree) { return _tree.layer->mapEpoch != _layer->mapEpoch || _tree.layer->costEpoch != _layer->costEpoch; }
+			),
+			std::end(trees)
+		);
+
+		auto itr = std::find_if(std::begin(trees), std::end(trees),
+			[&_layer](const Tree& _tree) { return _tree.layer->passabilityClass == _layer->passabilityClass; }
+		);
+		if (itr == std::end(trees))
+			itr = trees.insert(std::end(trees), Tree{});
+		if (itr->layer != _layer)
+			*itr = Tree{ _layer, build_shortest_path_tree(MapSnapshot{ 0, _layer, nullptr }, _hotspot.at) };
+		return itr->nextDirs;
+	}
+};
+
+inline static HotspotRegistry globalHotspots;
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef DYNRPG_PATHFINDER_MAP_SNAPSHOT_HPP
+#define DYNRPG_PATHFINDER_MAP_SNAPSHOT_HPP
+
+#pragma once
+
+#include "Pathfinding.hpp"
+#include "Vector.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+/* Passability and step costs of the whole map for one passability class. Characters are ignored while building this,
+ * thus it only has to be rebuilt when the map, the costs or the class changes. */
+struct StaticMapLayer
+{
+	int mapId = 0;
+	unsigned int mapEpoch = 0;
+	unsigned int costEpoch = 0;
+	int passabilityClass = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<std::uint8_t> passable;		// one bit per direction
+	std::vector<int> stepCosts;				// four entries per tile; cost of the destination tile plus the travel cost
+};
+
+/* Immutable view on the map, which may be safely shared with other threads. Layers are shared between snapshots
+ * and replaced instead of modified (copy-on-write), thus older snapshots stay valid while they are in use. */
+class MapSnapshot
+{
+public:
+	MapSnapshot(unsigned int _version, std::shared_ptr<const StaticMapLayer> _layer, std::shared_ptr<const std::vector<std::uint8_t>> _blockers) :
+		m_Version{ _version },
+		m_Layer{ std::move(_layer) },
+		m_Blockers{ std::move(_blockers) }
+	{
+		assert(m_Layer);
+	}
+
+	unsigned int version() const
+	{
+		return m_Version;
+	}
+
+	const std::shared_ptr<const StaticMapLayer>& layer() const
+	{
+		return m_Layer;
+	}
+
+	int width() const
+	{
+		return m_Layer->width;
+	}
+
+	int height() const
+	{
+		return m_Layer->height;
+	}
+
+	bool is_valid_pos(const Vector& _at) const
+	{
+		return 0 <= _at.x && _at.x < width() && 0 <= _at.y && _at.y < height();
+	}
+
+	int to_index(const Vector& _at) const
+	{
+		return _at.y * width() + _at.x;
+	}
+
+	Vector to_vector(int _index) const
+	{
+		return { _index % width(), _index / width() };
+	}
+
+	bool can_move(int _index, int _dir) const
+	{
+		return m_Layer->passable[_index] & (1 << _dir);
+	}
+
+	int step_cost(int _index, int _dir) const
+	{
+		return m_Layer->stepCosts[_index * 4 + _dir];
+	}
+
+	bool is_blocked(int _index) const
+	{
+		return m_Blockers && (*m_Blockers)[_index];
+	}
+
+private:
+	unsigned int m_Version;
+	std::shared_ptr<const StaticMapLayer> m_Layer;
+	std::shared_ptr<const std::vector<std::uint8_t>> m_Blockers;
+};
+
+using MapSnapshotPtr = std::shared_ptr<const MapSnapshot>;
+
+/* Creates snapshots on the main thread. Static layers will be kept as long as the map and the costs stay untouched;
+ * the blockers (characters which are able to block the path) will be collected at most once per frame. */
+class SnapshotProvider
+{
+public:
+	MapSnapshotPtr get(RPG::Character& _character)
+	{
+		auto layer = get_layer(_character);
+
+		// phasing characters and characters which aren't on the same layer as the hero won't be blocked by anybody
+		std::shared_ptr<const std::vector<std::uint8_t>> blockers;
+		if (!_character.phasing && _character.layer == RPG::LAYER_SAME_LEVEL_AS_HERO)
+		{
+			if (!m_Blockers || m_BlockerFrame != RPG::system->frameCounter || m_BlockerMapEpoch != layer->mapEpoch)
+			{
+				m_Blockers = _collect_blockers();
+				m_BlockerFrame = RPG::system->frameCounter;
+				m_BlockerMapEpoch = layer->mapEpoch;
+			}
+			blockers = m_Blockers;
+		}
+		return std::make_shared<const MapSnapshot>(++m_Version, std::move(layer), std::move(blockers));
+	}
+
+	std::shared_ptr<const StaticMapLayer> get_layer(RPG::Character& _character)
+	{
+		auto mapEpoch = update_map_epoch();
+		auto costEpoch = get_cost_epoch();
+		auto passabilityClass = get_passability_class(_character);
+
+		m_Layers.erase(
+			std::remove_if(std::begin(m_Layers), std::end(m_Layers),
+				[mapEpoch, costEpoch](const auto& _layer) { return _layer->mapEpoch != mapEpoch || _layer->costEpoch != costEpoch; }
+			),
+			std::end(m_Layers)
+		);
+
+		auto itr = std::find_if(std::begin(m_Layers), std::end(m_Layers),
+			[passabilityClass](const auto& _layer) { return _layer->passabilityClass == passabilityClass; }
+		);
+		if (itr == std::end(m_Layers))
+			itr = m_Layers.insert(std::end(m_Layers), _build_layer(_character, mapEpoch, costEpoch, passabilityClass));
+		return *itr;
+	}
+
+	void clear()
+	{
+		m_Layers.clear();
+		m_Blockers.reset();
+	}
+
+private:
+	unsigned int m_Version = 0;
+	std::vector<std::shared_ptr<const StaticMapLayer>> m_Layers;
+	std::shared_ptr<const std::vector<std::uint8_t>> m_Blockers;
+	int m_BlockerFrame = -1;
+	unsigned int m_BlockerMapEpoch = 0;
+
+	template <class TCallback>
+	static void _for_each_character(TCallback _callback)
+	{
+		_callback(*RPG::hero);
+		for_each_event([&_callback](int _id, RPG::Event& _event) { _callback(_event); });
+	}
+
+	/* Characters on the hero's layer are moved below the hero for a moment, thus they won't be taken into account by
+	 * RPG::Character::isMovePossible. Nothing is drawn in between, so nobody will ever notice. */
+	class CharacterLayerMask
+	{
+	public:
+		explicit CharacterLayerMask(RPG::Character& _except)
+		{
+			_for_each_character([this, &_except](RPG::Character& _character)
+				{
+					if (&_character != &_except && _character.layer == RPG::LAYER_SAME_LEVEL_AS_HERO)
+					{
+						m_Masked.emplace_back(&_character);
+						_character.layer = RPG::LAYER_BELOW_HERO;
+					}
+				}
+			);
+		}
+
+		~CharacterLayerMask()
+		{
+			for (auto character : m_Masked)
+				character->layer = RPG::LAYER_SAME_LEVEL_AS_HERO;
+		}
+
+		CharacterLayerMask(const CharacterLayerMask&) = delete;
+		CharacterLayerMask& operator =(const CharacterLayerMask&) = delete;
+
+	private:
+		std::vector<RPG::Character*> m_Masked;
+	};
+
+	static std::shared_ptr<const StaticMapLayer> _build_layer(RPG::Character& _character, unsigned int _mapEpoch, unsigned int _costEpoch, int _passabilityClass)
+	{
+		auto layer = std::make_shared<StaticMapLayer>();
+		layer->mapId = RPG::Map::properties->id;
+		layer->mapEpoch = _mapEpoch;
+		layer->costEpoch = _costEpoch;
+		layer->passabilityClass = _passabilityClass;
+		layer->width = RPG::map->getWidth();
+		layer->height = RPG::map->getHeight();
+
+		auto tileCount = static_cast<std::size_t>(layer->width) * layer->height;
+		std::vector<int> terrainIds(tileCount);
+		for (int y = 0; y < layer->height; ++y)
+		{
+			for (int x = 0; x < layer->width; ++x)
+				terrainIds[y * layer->width + x] = RPG::map->getTerrainId(RPG::map->getLowerLayerTileId(x, y));
+		}
+
+		layer->passable.resize(tileCount, 0);
+		layer->stepCosts.resize(tileCount * 4, 0);
+		CharacterLayerMask mask{ _character };
+		for (int y = 0; y < layer->height; ++y)
+		{
+			for (int x = 0; x < layer->width; ++x)
+			{
+				auto index = y * layer->width + x;
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					auto at = Vector{ x, y } + directionOffsets[dir];
+					if (!is_valid_pos(at) || !_character.isMovePossible(x, y, at.x, at.y))
+						continue;
+
+					auto toTerrainId = terrainIds[at.y * layer->width + at.x];
+					layer->passable[index] |= 1 << dir;
+					layer->stepCosts[index * 4 + dir] = globalCostCalculator.get_cost(toTerrainId) +
+						globalEdgeCostCalculator.get_cost(terrainIds[index], toTerrainId);
+				}
+			}
+		}
+		return layer;
+	}
+
+	static std::shared_ptr<const std::vector<std::uint8_t>> _collect_blockers()
+	{
+		auto width = RPG::map->getWidth();
+		auto height = RPG::map->getHeight();
+		auto blockers = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(width) * height, 0);
+		_for_each_character([&blockers, width, height](RPG::Character& _character)
+			{
+				if (_character.enabled && !_character.phasing && _character.layer == RPG::LAYER_SAME_LEVEL_AS_HERO &&
+					0 <= _character.x && _character.x < width && 0 <= _character.y && _character.y < height)
+					(*blockers)[_character.y * width + _character.x] = 1;
+			}
+		);
+		return blockers;
+	}
+};
+
+inline static SnapshotProvider globalSnapshotProvider;
+
+/* A* on a snapshot. This doesn't touch any RPG object, thus it may be called from any thread.
+ * The start tile is never treated as blocked, because it's usually occupied by the character itself.
+ * Local searches may limit the number of expanded tiles (0 = unlimited), thus unreachable goals won't flood the map. */
+inline std::optional<Path> search_path(const MapSnapshot& _snapshot, const Vector& _start, const Vector& _end, std::size_t _maxExpanded = 0)
+{
+	if (!_snapshot.is_valid_pos(_start) || !_snapshot.is_valid_pos(_end))
+		return std::nullopt;
+
+	// buffers are reused between searches of the same thread; the stamps make clearing them unnecessary
+	struct SearchBuffers
+	{
+		unsigned int stamp = 0;
+		std::vector<unsigned int> seen;
+		std::vector<unsigned int> closed;
+		std::vector<int> weights;
+		std::vector<std::int8_t> parentDirs;
+
+		void prepare(std::size_t _size)
+		{
+			if (std::size(seen) < _size)
+			{
+				seen.assign(_size, 0);
+				closed.assign(_size, 0);
+				weights.resize(_size);
+				parentDirs.resize(_size);
+			}
+			++stamp;
+		}
+	};
+	thread_local SearchBuffers buffers;
+	buffers.prepare(static_cast<std::size_t>(_snapshot.width()) * _snapshot.height());
+
+	auto heuristic = [&_end](const Vector& _at) { return (_end - _at).manhattan_length(); };
+
+	using OpenNode = std::pair<int, int>;	// estimated total cost, tile index
+	std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<>> openList;
+	auto startIndex = _snapshot.to_index(_start);
+	auto endIndex = _snapshot.to_index(_end);
+	buffers.seen[startIndex] = buffers.stamp;
+	buffers.weights[startIndex] = 0;
+	buffers.parentDirs[startIndex] = -1;
+	openList.emplace(heuristic(_start), startIndex);
+	std::size_t expanded = 0;
+	while (!std::empty(openList))
+	{
+		auto index = openList.top().second;
+		openList.pop();
+		if (buffers.closed[index] == buffers.stamp)
+			continue;
+		buffers.closed[index] = buffers.stamp;
+		if (0 < _maxExpanded && _maxExpanded < ++expanded)
+			return std::nullopt;
+
+		if (index == endIndex)
+		{
+			Path path;
+			for (auto at = _end; ; at -= directionOffsets[buffers.parentDirs[_snapshot.to_index(at)]])
+			{
+				path.emplace_back(at);
+				if (at == _start)
+					break;
+			}
+			std::reverse(std::begin(path), std::end(path));
+			return path;
+		}
+
+		auto pos = _snapshot.to_vector(index);
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			if (!_snapshot.can_move(index, dir))
+				continue;
+
+			auto at = pos + directionOffsets[dir];
+			auto atIndex = _snapshot.to_index(at);
+			if (_snapshot.is_blocked(atIndex) || buffers.closed[atIndex] == buffers.stamp)
+				continue;
+
+			auto weight = buffers.weights[index] + _snapshot.step_cost(index, dir);
+			if (buffers.seen[atIndex] != buffers.stamp || weight < buffers.weights[atIndex])
+			{
+				buffers.seen[atIndex] = buffers.stamp;
+				buffers.weights[atIndex] = weight;
+				buffers.parentDirs[atIndex] = static_cast<std::int8_t>(dir);
+				openList.emplace(weight + heuristic(at), atIndex);
+			}
+		}
+	}
+	return std::nullopt;
+}
+
+/* Dijkstra from the goal over the reversed edges. The result contains for each tile the direction of its first step
+ * on the cheapest path towards the goal, or -1 if the goal isn't reachable from there. Blockers are ignored. */
+inline std::vector<std::int8_t> build_shortest_path_tree(const MapSnapshot& _snapshot, const Vector& _goal)
+{
+	auto tileCount = static_cast<std::size_t>(_snapshot.width()) * _snapshot.height();
+	std::vector<std::int8_t> nextDirs(tileCount, -1);
+	if (!_snapshot.is_valid_pos(_goal))
+		return nextDirs;
+
+	std::vector<int> weights(tileCount, -1);
+	std::vector<bool> closed(tileCount, false);
+	using OpenNode = std::pair<int, int>;	// cost to the goal, tile index
+	std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<>> openList;
+	auto goalIndex = _snapshot.to_index(_goal);
+	weights[goalIndex] = 0;
+	openList.emplace(0, goalIndex);
+	while (!std::empty(openList))
+	{
+		auto index = openList.top().second;
+		openList.pop();
+		if (closed[index])
+			continue;
+		closed[index] = true;
+
+		auto pos = _snapshot.to_vector(index);
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			// looking for tiles, which are able to step onto the current one
+			auto from = pos - directionOffsets[dir];
+			if (!_snapshot.is_valid_pos(from))
+				continue;
+
+			auto fromIndex = _snapshot.to_index(from);
+			if (closed[fromIndex] || !_snapshot.can_move(fromIndex, dir))
+				continue;
+
+			auto weight = weights[index] + _snapshot.step_cost(fromIndex, dir);
+			if (weights[fromIndex] < 0 || weight < weights[fromIndex])
+			{
+				weights[fromIndex] = weight;
+				nextDirs[fromIndex] = static_cast<std::int8_t>(dir);
+				openList.emplace(weight, fromIndex);
+			}
+		}
+	}
+	return nextDirs;
+}
+
+/* Follows the next step directions from the start to the goal; fails if the goal isn't reachable or the way is currently blocked.
+ * TNextDir has to return the direction of the next step for a given tile index, or a negative value if there is none. */
+template <class TNextDir>
+std::optional<Path> walk_next_dirs(const MapSnapshot& _snapshot, TNextDir _nextDir, const Vector& _start, const Vector& _goal)
+{
+	if (!_snapshot.is_valid_pos(_start))
+		return std::nullopt;
+
+	auto maxLength = static_cast<std::size_t>(_snapshot.width()) * _snapshot.height();
+	Path path{ _start };
+	for (auto at = _start; at != _goal; )
+	{
+		int dir = _nextDir(_snapshot.to_index(at));
+		if (dir < 0 || maxLength < std::size(path))
+			return std::nullopt;
+
+		at += directionOffsets[dir];
+		if (_snapshot.is_blocked(_snapshot.to_index(at)))
+			return std::nullopt;
+		path.emplace_back(at);
+	}
+	return path;
+}
+
+inline std::optional<Path> walk_shortest_path_tree(const MapSnapshot& _snapshot, const std::vector<std::int8_t>& _nextDirs, const Vector& _start, const Vector& _goal)
+{
+	return walk_next_dirs(_snapshot, [&_nextDirs](int _index) { return _nextDirs[_index]; }, _start, _goal);
+}
+
+/* Searches a detour from _at back onto the path, which rejoins it at the first reachable and unblocked vertex within
+ * _window vertices after _fromIndex. The result starts at _at and contains the remaining vertices behind the detour. */
+inline std::optional<Path> find_detour(const MapSnapshot& _snapshot, const std::vector<Vector>& _vertices, const Vector& _at,
+	std::size_t _fromIndex, std::size_t _window, std::size_t _maxExpanded)
+{
+	for (auto i = _fromIndex + 1; i < std::size(_vertices) && i <= _fromIndex + _window; ++i)
+	{
+		if (!_snapshot.is_valid_pos(_vertices[i]) || _snapshot.is_blocked(_snapshot.to_index(_vertices[i])))
+			continue;
+
+		if (auto detour = search_path(_snapshot, _at, _vertices[i], _maxExpanded))
+		{
+			detour->insert(std::end(*detour), std::begin(_vertices) + i + 1, std::end(_vertices));
+			return detour;
+		}
+		if (_maxExpanded == 0)
+			break;
+	}
+	return std::nullopt;
+}
+
+// falls back to a complete search towards the end of the path, if there is no detour
+inline std::optional<Path> repair_path(const MapSnapshot& _snapshot, const CompactPath& _path, std::size_t _fromIndex, const Vector& _at, std::size_t _window)
+{
+	auto vertices = _path.decode();
+	if (std::empty(vertices))
+		return std::nullopt;
+
+	if (auto detour = find_detour(_snapshot, vertices, _at, _fromIndex, _window, 0))
+		return detour;
+	return search_path(_snapshot, _at, vertices.back());
+}
+
+/* Checks the next steps behind the cursor against the passability and the blockers of the snapshot. Diagonal steps are
+ * only checked for blockers. Returns the index of the vertex in front of the first invalid step, if there is any. */
+inline std::optional<std::size_t> find_invalid_step(const MapSnapshot& _snapshot, const CompactPath& _path, CompactPath::Cursor _cursor, std::size_t _lookahead)
+{
+	for (std::size_t i = 0; i < _lookahead; ++i)
+	{
+		auto from = _cursor;
+		if (!_path.advance(_cursor))
+			break;
+
+		if (!_snapshot.is_valid_pos(_cursor.at) || _snapshot.is_blocked(_snapshot.to_index(_cursor.at)) ||
+			(_cursor.dir < 4 && (!_snapshot.is_valid_pos(from.at) || !_snapshot.can_move(_snapshot.to_index(from.at), _cursor.dir))))
+			return from.index;
+	}
+	return std::nullopt;
+}
+
+/* Replaces the invalid step behind _fromIndex by a detour, which has to rejoin the path within the window. The search
+ * is limited to the surroundings of the window; the vertices in front of _fromIndex stay untouched. */
+inline std::optional<Path> repair_step(const MapSnapshot& _snapshot, const CompactPath& _path, std::size_t _fromIndex, std::size_t _window)
+{
+	auto vertices = _path.decode();
+	if (std::size(vertices) <= _fromIndex)
+		return std::nullopt;
+
+	auto extent = 2 * _window + 1;
+	auto detour = find_detour(_snapshot, vertices, vertices[_fromIndex], _fromIndex, _window, extent * extent);
+	if (!detour)
+		return std::nullopt;
+
+	vertices.erase(std::begin(vertices) + _fromIndex, std::end(vertices));
+	vertices.insert(std::end(vertices), std::begin(*detour), std::end(*detour));
+	return vertices;
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef DYNRPG_PATHFINDER_PATHFINDER_HPP
+#define DYNRPG_PATHFINDER_PATHFINDER_HPP
+
+#pragma once
+
+#include "Pathfinding.hpp"
+#include "Hotspots.hpp"
+#include "AllPairs.hpp"
+
+// answers requests, which don't need any search at all
+inline std::optional<Path> find_precomputed_path(RPG::Character& _character, const PathRequestKey& _key)
+{
+	if (auto path = globalHotspots.find_path(_character, _key.start, _key.end))
+		return path;
+	return globalAllPairs.find_path(_character, _key.start, _key.end);
+}
+
+class Pathfinder
+{
+public:
+	std::optional<int> calc_path(const Vector& _end, RPG::Character& _character)
+	{
+		Vector start{ _character.x, _character.y };
+
+		auto key = make_request_key(_character, _end);
+		if (auto entry = find_known_path(key))
+		{
+			if (*entry)
+				return globalPathMgr.insert_path(std::move(*entry), &_character);
+			return std::nullopt;
+		}
+
+		if (auto precomputedPath = find_precomputed_path(_character, key))
+		{
+			auto path = std::make_shared<const CompactPath>(*precomputedPath);
+			remember_path(key, path);
+			return globalPathMgr.insert_path(std::move(path), &_character);
+		}
+
+		struct VectorLess
+		{
+			bool operator ()(const Vector& _lhs, const Vector& _rhs) const
+			{
+				return _lhs.x < _rhs.x || (_lhs.x == _rhs.x && _lhs.y < _rhs.y);
+			}
+		};
+
+		auto costCalculator = [](const Vector& _pos)
+		{
+			auto tileId = RPG::map->getLowerLayerTileId(_pos.x, _pos.y);
+			return globalCostCalculator.get_cost(RPG::map->getTerrainId(tileId));
+			//return RPG::map->getTerrainId(tileId);
+		};
+
+		auto edgeCostCalculator = [](const Vector& _from, const Vector& _to)
+		{
+			auto fromTerrainId = RPG::map->getTerrainId(RPG::map->getLowerLayerTileId(_from.x, _from.y));
+			auto toTerrainId = RPG::map->getTerrainId(RPG::map->getLowerLayerTileId(_to.x, _to.y));
+			return globalEdgeCostCalculator.get_cost(fromTerrainId, toTerrainId);
+			//return RPG::map->getTerrainId(tileId);
+		};
+		
+		auto heuristicCalculator = [](const Vector& _pos, const Vector& _dest)
+		{
+			auto diff = _dest - _pos;
+			return std::abs(diff.x) + std::abs(diff.y);
+		};
+
+		auto neighbourSearcher = [&_character](const auto& _node, auto&& _callback)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				Vector dir{ 0, 0 };
+				switch (i)
+				{
+				case 0: dir.x = 1; break;
+				case 1: dir.x = -1; break;
+				case 2: dir.y = 1; break;
+				case 3: dir.y = -1; break;
+				}
+				auto at = _node.vertex + dir;
+				if (is_valid_pos(at) && _character.isMovePossible(_node.vertex.x, _node.vertex.y, at.x, at.y))
+					_callback(at);
+			}
+		};
+
+		class TableVisitationTracker
+		{
+		public:
+			TableVisitationTracker(std::size_t _width, std::size_t _height) :
+				m_Tracker{ _width, _height }
+			{
+			}
+			
+			decltype(auto) operator [](const Vector& _at)
+			{
+				return m_Tracker[_at.x][_at.y];
+			}
+			
+		private:
+			sl::container::Vector2d<bool> m_Tracker;
+		};
+
+		using Node = sl::graph::AStarNode<Vector, int>;
+		struct NodeVectorLess
+		{
+			bool operator ()(const Node& _lhs, const Node& _rhs) const
+			{
+				return VectorLess{}(_lhs.vertex, _rhs.vertex);
+			}
+
+			bool operator ()(const Node& _lhs, const Vector& _rhs) const
+			{
+				return VectorLess{}(_lhs.vertex, _rhs);
+			}
+
+			bool operator ()(const Vector& _lhs, const Node& _rhs) const
+			{
+				return VectorLess{}(_lhs, _rhs.vertex);
+			}
+		};
+		
+		sl::container::SortedVector<Node, NodeVectorLess> closedList;
+		sl::graph::traverse_astar(start, _end, neighbourSearcher,
+			TableVisitationTracker{ static_cast<std::size_t>(RPG::map->getWidth()), static_cast<std::size_t>(RPG::map->getHeight()) },
+			heuristicCalculator, costCalculator, edgeCostCalculator,
+			[&closedList](const Node& _node)
+			{
+				closedList.insert(_node);
+			}
+		);
+		
+		PathPtr path;
+		if (auto optPath = _extract_path(closedList, _end))
+			path = std::make_shared<const CompactPath>(*optPath);
+		remember_path(key, path);
+
+		if (path)
+			return globalPathMgr.insert_path(std::move(path), &_character);
+		return std::nullopt;
+	}
+	
+private:
+	template <class TClosedList>
+	std::optional<Path> _extract_path(const TClosedList& _closedList, Vector _end)
+	{
+		Path path;
+		auto itr = _closedList.find(_end);
+		if (itr == std::end(_closedList))
+			return std::nullopt;
+
+		path.emplace_back(itr->vertex);
+		while (itr->parent)
+		{
+			path.emplace_back(*itr->parent);
+			itr = _closedList.find(*itr->parent);
+		}
+		std::reverse(std::begin(path), std::end(path));
+		return path;
+	}
+};
+
+#endif
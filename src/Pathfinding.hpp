@@ -1,15 +1,28 @@
+#ifndef DYNRPG_PATHFINDER_PATHFINDING_HPP
+#define DYNRPG_PATHFINDER_PATHFINDING_HPP
+
+#pragma once
+
 #include "Simple-Graph/algorithm.hpp"
 #include "Simple-Utility/container/Vector2d.hpp"
 #include "Simple-Utility/container/SortedVector.hpp"
 
+#include "Binary.hpp"
 #include "Vector.hpp"
+#include "CompactPath.hpp"
 
 #include <DynRPG/DynRPG.h>
 
 #include <cassert>
+#include <cstdint>
+#include <deque>
 #include <variant>
 #include <algorithm>
 #include <chrono>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 
 #undef max		// lol
 
@@ -42,45 +55,654 @@ struct IdLess
 template <class TData>
 using IdDataSortedVector = sl::container::SortedVector<IdData<TData>, IdLess>;
 
-class PathManager
+// paths are immutable after creation, thus identical requests are able to share the same path object
+using PathPtr = std::shared_ptr<const CompactPath>;
+
+/* Grows whenever another map has been entered or the game has been loaded. Nothing is torn down on map changes; everything
+ * which depends on the map remembers the epoch it has been created in and treats itself as outdated as soon as it differs. */
+inline static unsigned int globalMapEpoch = 0;
+inline static int globalMapEpochMapId = 0;
+
+// cheap enough to be called whenever map related data is about to be touched
+inline unsigned int update_map_epoch()
+{
+	if (auto mapId = RPG::Map::properties->id; mapId != globalMapEpochMapId)
+	{
+		globalMapEpochMapId = mapId;
+		++globalMapEpoch;
+	}
+	return globalMapEpoch;
+}
+
+/* Event IDs may have gaps (events which have been deleted in the editor), thus count() isn't the highest ID. Like
+ * RPG::Map::getEventAt does, each gap extends the search by one, until every existing event has been visited. */
+template <class TCallback>
+void for_each_event(TCallback _callback)
 {
+	for (int i = 1, count = RPG::map->events.count(); i <= count; ++i)
+	{
+		if (auto event = RPG::map->events[i])
+			_callback(i, *event);
+		else
+			++count;
+	}
+}
+
+/* Event handles of the current map, resolved once per map epoch. Comments refer to events by their IDs over and over
+ * again, thus a lookup is just a bounds check and an array access afterwards. */
+class CharacterTable
+{
+public:
+	// nullptr for IDs which don't exist on the current map
+	RPG::Event* find_event(int _eventId)
+	{
+		_sync_map_epoch();
+		if (_eventId <= 0 || static_cast<int>(std::size(m_Events)) <= _eventId)
+			return nullptr;
+		return m_Events[_eventId];
+	}
+
 private:
-	using PathNode = IdData<Path>;
-	
+	std::vector<RPG::Event*> m_Events;		// index 0 is unused, as event IDs start at 1
+	unsigned int m_MapEpoch = 0;
+
+	void _sync_map_epoch()
+	{
+		if (m_MapEpoch == update_map_epoch())
+			return;
+
+		m_MapEpoch = globalMapEpoch;
+		m_Events.assign(1, nullptr);
+		for_each_event([this](int _id, RPG::Event& _event)
+		{
+			if (static_cast<int>(std::size(m_Events)) <= _id)
+				m_Events.resize(static_cast<std::size_t>(_id) + 1, nullptr);
+			m_Events[_id] = &_event;
+		});
+	}
+};
+
+inline static CharacterTable globalCharacters;
+
+// characters are stored by a code in the save data: 0 = none, -1 = hero, -2 .. -4 = vehicles, event IDs otherwise
+inline int to_character_code(const RPG::Character* _character)
+{
+	if (!_character)
+		return 0;
+	if (_character == RPG::hero)
+		return -1;
+	if (_character == RPG::vehicleSkiff)
+		return -2;
+	if (_character == RPG::vehicleShip)
+		return -3;
+	if (_character == RPG::vehicleAirship)
+		return -4;
+	return _character->id;
+}
+
+inline RPG::Character* from_character_code(int _code)
+{
+	switch (_code)
+	{
+	case 0: return nullptr;
+	case -1: return RPG::hero;
+	case -2: return RPG::vehicleSkiff;
+	case -3: return RPG::vehicleShip;
+	case -4: return RPG::vehicleAirship;
+	default:
+		return globalCharacters.find_event(_code);
+	}
+}
+
+/* Generational slot map. Path IDs consist of the slot index and the generation of the slot, thus insertion, lookup and
+ * removal don't need any search and IDs of removed paths won't ever refer to a reused slot. Free slots are reused in order
+ * of their release, and slots whose generation is exhausted are retired instead of wrapping around.
+ * The slots are also chained in order of their last usage, thus the least recently used paths can be evicted as soon as
+ * the memory limit is exceeded. */
+class PathManager
+{
 public:
-	const Path* find_path(int _id) const
+	struct Step
 	{
-		if (auto itr = m_Paths.find(_id); itr != std::end(m_Paths))
-			return &std::get<Path>(*itr);
+		int direction;			// RPG::Direction
+		Vector at;
+		bool finished;			// the last vertex has been reached
+	};
+
+	struct Stats
+	{
+		std::size_t count = 0;
+		std::size_t memorySize = 0;
+		std::size_t evictions = 0;
+	};
+
+	const CompactPath* find_path(int _id) const
+	{
+		if (auto slot = _find_slot(_id))
+		{
+			_touch(_to_index(_id));
+			return slot->path.get();
+		}
+		return nullptr;
+	}
+
+	PathPtr share_path(int _id) const
+	{
+		if (auto slot = _find_slot(_id))
+		{
+			_touch(_to_index(_id));
+			return slot->path;
+		}
 		return nullptr;
 	}
 
-	int insert_path(Path _path)
+	// each ID has its own decoding cursor, thus iterating over the vertices doesn't decode the path over and over again
+	std::optional<Vector> get_vertex(int _id, std::size_t _index) const
 	{
-		auto id = m_NextId++;
-		m_Paths.insert(PathNode{ id, std::move(_path) });
-		return id;
+		if (auto slot = _find_slot(_id))
+		{
+			_touch(_to_index(_id));
+			return slot->path->vertex(_index, slot->cursor);
+		}
+		return std::nullopt;
+	}
+
+	// moves the path's walking cursor one step further; returns std::nullopt if the path doesn't exist or is already finished
+	std::optional<Step> next_step(int _id)
+	{
+		auto slot = _find_slot(_id);
+		if (!slot || !slot->path->advance(slot->walker))
+			return std::nullopt;
+
+		auto& walker = slot->walker;
+		Step step{ walker.dir, walker.at, slot->path->size() <= walker.index + 1 };
+		if (step.finished)
+			complete_path(_id);
+		else
+			_touch(_to_index(_id));
+		return step;
+	}
+
+	/* The character is remembered for validating the path later on; it stays valid as long as the path does.
+	 * Fails only if every possible index is in use. */
+	std::optional<int> insert_path(PathPtr _path, RPG::Character* _character = nullptr)
+	{
+		assert(_path);
+		std::uint32_t index = 0;
+		if (!std::empty(m_FreeSlots))
+		{
+			index = m_FreeSlots.front();
+			m_FreeSlots.pop_front();
+		}
+		else if (indexMask < std::size(m_Slots))
+			return std::nullopt;
+		else
+		{
+			index = static_cast<std::uint32_t>(std::size(m_Slots));
+			m_Slots.emplace_back();
+		}
+
+		auto& slot = m_Slots[index];
+		slot.cursor = _path->begin();
+		slot.walker = _path->begin();
+		slot.mapEpoch = globalMapEpoch;
+		slot.character = _character;
+		slot.path = std::move(_path);
+		_add_memory(slot.path);
+		_link_front(index);
+		_enforce_memory_limit();
+		return _make_id(index, slot.generation);
+	}
+
+	std::optional<int> insert_path(Path _path, RPG::Character* _character = nullptr)
+	{
+		return insert_path(std::make_shared<const CompactPath>(_path), _character);
+	}
+
+	// keeps the walking cursor at its index; the path must not differ from the old one in front of it
+	bool replace_path(int _id, PathPtr _path)
+	{
+		assert(_path);
+		auto slot = _find_slot(_id);
+		if (!slot)
+			return false;
+
+		auto walker = _path->begin();
+		while (walker.index < slot->walker.index && _path->advance(walker))
+			;
+		_remove_memory(slot->path);
+		_add_memory(_path);
+		slot->cursor = _path->begin();
+		slot->walker = walker;
+		slot->path = std::move(_path);
+		_touch(_to_index(_id));
+		_enforce_memory_limit();
+		return true;
+	}
+
+	RPG::Character* find_character(int _id) const
+	{
+		if (auto slot = _find_slot(_id))
+			return slot->character;
+		return nullptr;
+	}
+
+	std::optional<CompactPath::Cursor> get_walker(int _id) const
+	{
+		if (auto slot = _find_slot(_id))
+			return slot->walker;
+		return std::nullopt;
 	}
 
 	void clear_path(int _id)
 	{
-		if (auto itr = m_Paths.find(_id); itr != std::end(m_Paths))
-			m_Paths.erase(itr);
+		if (_find_slot(_id))
+			_release(_to_index(_id));
+	}
+
+	// owned paths will be released as soon as the owner's page changes or the path has been walked completely
+	bool set_owner(int _id, int _eventId)
+	{
+		auto slot = _find_slot(_id);
+		if (!slot)
+			return false;
+
+		slot->ownerId = 0;
+		slot->ownerPage = nullptr;
+		if (_eventId == 0)
+			return true;
+
+		auto owner = _find_event(_eventId);
+		if (!owner)
+			return false;
+		slot->ownerId = _eventId;
+		slot->ownerPage = owner->currentPage;
+		return true;
+	}
+
+	// groups let a single command step several paths at once; group 0 removes the path from its group
+	bool set_group(int _id, int _groupId)
+	{
+		auto slot = _find_slot(_id);
+		if (!slot)
+			return false;
+		slot->groupId = _groupId;
+		return true;
+	}
+
+	// _func(id, character) is called for each path of the group; it may release the path
+	template <class TFunc>
+	void for_each_in_group(int _groupId, TFunc _func)
+	{
+		if (_groupId == 0)
+			return;
+
+		for (std::uint32_t i = 0; i < std::size(m_Slots); ++i)
+		{
+			auto& slot = m_Slots[i];
+			if (slot.path && slot.mapEpoch == globalMapEpoch && slot.groupId == _groupId)
+				_func(_make_id(i, slot.generation), slot.character);
+		}
+	}
+
+	void complete_path(int _id)
+	{
+		if (auto slot = _find_slot(_id); slot && slot->ownerId != 0)
+			_release(_to_index(_id));
+	}
+
+	// has to be called each frame; paths of previous maps are already unreachable, this just frees their memory
+	void release_outdated()
+	{
+		for (std::uint32_t i = 0; i < std::size(m_Slots); ++i)
+		{
+			auto& slot = m_Slots[i];
+			if (!slot.path)
+				continue;
+
+			if (slot.mapEpoch != globalMapEpoch)
+				_release(i);
+			else if (slot.ownerId != 0)
+			{
+				auto owner = _find_event(slot.ownerId);
+				if (!owner || owner->currentPage != slot.ownerPage)
+					_release(i);
+			}
+		}
+	}
+
+	// 0 disables the limit; the most recently inserted path is never evicted, even if it exceeds the limit on its own
+	void set_memory_limit(std::size_t _bytes)
+	{
+		m_MemoryLimit = _bytes;
+		_enforce_memory_limit();
+	}
+
+	Stats stats() const
+	{
+		return Stats{ std::size(m_Slots) - std::size(m_FreeSlots) - m_RetiredSlots, m_MemorySize, m_Evictions };
+	}
+	
+	// only paths of the current map are written; their IDs are kept, because the game variables still refer to them
+	void write(BinaryWriter& _writer) const
+	{
+		std::uint32_t count = 0;
+		for (auto& slot : m_Slots)
+			count += slot.path && slot.mapEpoch == globalMapEpoch ? 1 : 0;
+		_writer.write_u32(count);
+
+		for (std::uint32_t i = 0; i < std::size(m_Slots); ++i)
+		{
+			auto& slot = m_Slots[i];
+			if (!slot.path || slot.mapEpoch != globalMapEpoch)
+				continue;
+
+			_writer.write_i32(_make_id(i, slot.generation));
+			_writer.write_i32(to_character_code(slot.character));
+			_writer.write_i32(slot.ownerId);
+			_writer.write_i32(slot.groupId);
+			_writer.write_u32(static_cast<std::uint32_t>(slot.walker.index));
+			slot.path->write(_writer);
+		}
+	}
+
+	/* The characters of the loaded map aren't available while the save data is read, thus the paths are kept aside
+	 * until restore_pending is called. */
+	bool read(BinaryReader& _reader, std::uint32_t _version)
+	{
+		m_PendingPaths.clear();
+		std::uint32_t count = 0;
+		if (!_reader.read_count(count, _version < 2 ? 16 : 20))
+			return false;
+
+		m_PendingPaths.reserve(count);
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			PendingPath pending;
+			if (!_reader.read_i32(pending.id) || !_reader.read_i32(pending.characterCode) || !_reader.read_i32(pending.ownerId) ||
+				(2 <= _version && !_reader.read_i32(pending.groupId)) || !_reader.read_u32(pending.walkerIndex))
+				return false;
+
+			auto path = CompactPath::read(_reader);
+			if (!path)
+				return false;
+			pending.path = std::make_shared<const CompactPath>(std::move(*path));
+			m_PendingPaths.emplace_back(std::move(pending));
+		}
+		return true;
+	}
+
+	void discard_pending()
+	{
+		m_PendingPaths.clear();
+	}
+
+	// has to be called as soon as the loaded map is active
+	void restore_pending()
+	{
+		if (std::empty(m_PendingPaths))
+			return;
+
+		clear();
+		for (auto& pending : m_PendingPaths)
+			_restore(pending);
+		m_PendingPaths.clear();
+		_enforce_memory_limit();
 	}
 	
+	// slots stay alive, thus IDs of cleared paths are still detected as outdated
 	void clear()
 	{
-		m_Paths.clear();
-		m_NextId = 1;
+		for (std::uint32_t i = 0; i < std::size(m_Slots); ++i)
+		{
+			if (m_Slots[i].path)
+				_release(i);
+		}
 	}
 
 private:
-	int m_NextId = 1;
-	IdDataSortedVector<Path> m_Paths;
+	static constexpr int indexBits = 20;
+	static constexpr std::uint32_t indexMask = (1u << indexBits) - 1;
+	static constexpr std::uint32_t generationMask = (1u << (31 - indexBits)) - 1;	// IDs have to stay positive
+	static constexpr std::uint32_t noSlot = ~0u;
+
+	struct Slot
+	{
+		std::uint32_t generation = 1;
+		PathPtr path;
+		mutable CompactPath::Cursor cursor;		// random access
+		CompactPath::Cursor walker;				// next_step
+		unsigned int mapEpoch = 0;
+		RPG::Character* character = nullptr;
+		int ownerId = 0;
+		const RPG::EventPage* ownerPage = nullptr;
+		int groupId = 0;
+		mutable std::uint32_t prevUsed = noSlot;
+		mutable std::uint32_t nextUsed = noSlot;
+	};
+
+	struct PendingPath
+	{
+		std::int32_t id = 0;
+		std::int32_t characterCode = 0;
+		std::int32_t ownerId = 0;
+		std::int32_t groupId = 0;
+		std::uint32_t walkerIndex = 0;
+		PathPtr path;
+	};
+
+	std::vector<Slot> m_Slots;
+	std::deque<std::uint32_t> m_FreeSlots;
+	std::size_t m_RetiredSlots = 0;		// generation 0 marks them
+	std::vector<PendingPath> m_PendingPaths;
+	mutable std::uint32_t m_MostRecent = noSlot;
+	mutable std::uint32_t m_LeastRecent = noSlot;
+	std::unordered_map<const CompactPath*, std::size_t> m_PathRefs;		// number of slots per path object
+	std::size_t m_MemorySize = 0;
+	std::size_t m_MemoryLimit = 0;
+	std::size_t m_Evictions = 0;
+
+	static int _make_id(std::uint32_t _index, std::uint32_t _generation)
+	{
+		return static_cast<int>(_generation << indexBits | _index);
+	}
+
+	static std::uint32_t _to_index(int _id)
+	{
+		return static_cast<std::uint32_t>(_id) & indexMask;
+	}
+
+	static RPG::Event* _find_event(int _eventId)
+	{
+		return globalCharacters.find_event(_eventId);
+	}
+
+	Slot* _find_slot(int _id)
+	{
+		return const_cast<Slot*>(std::as_const(*this)._find_slot(_id));
+	}
+
+	const Slot* _find_slot(int _id) const
+	{
+		auto index = _to_index(_id);
+		if (_id <= 0 || std::size(m_Slots) <= index)
+			return nullptr;
+
+		auto& slot = m_Slots[index];
+		if (slot.generation != static_cast<std::uint32_t>(_id) >> indexBits || !slot.path || slot.mapEpoch != globalMapEpoch)
+			return nullptr;
+		return &slot;
+	}
+
+	void _link_front(std::uint32_t _index) const
+	{
+		auto& slot = m_Slots[_index];
+		slot.prevUsed = noSlot;
+		slot.nextUsed = m_MostRecent;
+		if (m_MostRecent != noSlot)
+			m_Slots[m_MostRecent].prevUsed = _index;
+		else
+			m_LeastRecent = _index;
+		m_MostRecent = _index;
+	}
+
+	void _unlink(std::uint32_t _index) const
+	{
+		auto& slot = m_Slots[_index];
+		if (slot.prevUsed != noSlot)
+			m_Slots[slot.prevUsed].nextUsed = slot.nextUsed;
+		else
+			m_MostRecent = slot.nextUsed;
+		if (slot.nextUsed != noSlot)
+			m_Slots[slot.nextUsed].prevUsed = slot.prevUsed;
+		else
+			m_LeastRecent = slot.prevUsed;
+		slot.prevUsed = slot.nextUsed = noSlot;
+	}
+
+	void _touch(std::uint32_t _index) const
+	{
+		if (m_MostRecent != _index)
+		{
+			_unlink(_index);
+			_link_front(_index);
+		}
+	}
+
+	void _enforce_memory_limit()
+	{
+		while (m_MemoryLimit != 0 && m_MemoryLimit < m_MemorySize && m_LeastRecent != m_MostRecent)
+		{
+			_release(m_LeastRecent);
+			++m_Evictions;
+		}
+	}
+
+	void _restore(const PendingPath& _pending)
+	{
+		auto index = _to_index(_pending.id);
+		auto generation = static_cast<std::uint32_t>(_pending.id) >> indexBits;
+		if (_pending.id <= 0 || generation == 0 || generationMask < generation)
+			return;
+
+		if (std::size(m_Slots) <= index)
+		{
+			for (auto i = static_cast<std::uint32_t>(std::size(m_Slots)); i < index; ++i)
+				m_FreeSlots.emplace_back(i);
+			m_Slots.resize(index + 1);
+		}
+		else if (auto itr = std::find(std::begin(m_FreeSlots), std::end(m_FreeSlots), index); itr != std::end(m_FreeSlots))
+			m_FreeSlots.erase(itr);
+		// IDs of the save supersede the ones which have been handed out since then
+		else if (m_Slots[index].generation == 0 && !m_Slots[index].path)
+			--m_RetiredSlots;
+		else
+			return;
+
+		auto& slot = m_Slots[index];
+		slot.generation = generation;
+		slot.path = _pending.path;
+		slot.cursor = slot.path->begin();
+		slot.walker = slot.path->begin();
+		while (slot.walker.index < _pending.walkerIndex && slot.path->advance(slot.walker))
+			;
+		slot.mapEpoch = globalMapEpoch;
+		slot.character = from_character_code(_pending.characterCode);
+		if (auto owner = _find_event(_pending.ownerId))
+		{
+			slot.ownerId = _pending.ownerId;
+			slot.ownerPage = owner->currentPage;
+		}
+		slot.groupId = _pending.groupId;
+		_add_memory(slot.path);
+		_link_front(index);
+	}
+
+	// paths which are shared by several IDs (coalesced requests, cache hits) are counted only once
+	void _add_memory(const PathPtr& _path)
+	{
+		if (++m_PathRefs[_path.get()] == 1)
+			m_MemorySize += _path->memory_size();
+	}
+
+	void _remove_memory(const PathPtr& _path)
+	{
+		auto itr = m_PathRefs.find(_path.get());
+		assert(itr != std::end(m_PathRefs));
+		if (--itr->second == 0)
+		{
+			m_MemorySize -= _path->memory_size();
+			m_PathRefs.erase(itr);
+		}
+	}
+
+	// generation 0 is never handed out, thus valid IDs are never 0
+	void _release(std::uint32_t _index)
+	{
+		_unlink(_index);
+		auto& slot = m_Slots[_index];
+		_remove_memory(slot.path);
+		slot.ownerId = 0;
+		slot.ownerPage = nullptr;
+		slot.groupId = 0;
+		slot.character = nullptr;
+		slot.path.reset();
+		if (slot.generation < generationMask)
+		{
+			++slot.generation;
+			m_FreeSlots.emplace_back(_index);
+		}
+		else
+		{
+			slot.generation = 0;
+			++m_RetiredSlots;
+		}
+	}
 };
 
 inline static PathManager globalPathMgr;
 
+/* Costs which are bound to RPG variables may change without any notice, thus their current values are tracked, too.
+ * The epoch grows whenever the costs might have changed. */
+class CostEpoch
+{
+public:
+	void bump()
+	{
+		++m_Epoch;
+		m_VarValues.clear();
+	}
+
+	template <class TRange, class TValueProjection>
+	unsigned int get(const TRange& _costs, TValueProjection _valueProj) const
+	{
+		std::size_t i = 0;
+		for (auto& el : _costs)
+		{
+			if (auto value = _valueProj(el); value < 0)
+			{
+				auto varValue = RPG::system->variables[-value];
+				if (i == std::size(m_VarValues))
+				{
+					m_VarValues.emplace_back(varValue);
+					++m_Epoch;
+				}
+				else if (m_VarValues[i] != varValue)
+				{
+					m_VarValues[i] = varValue;
+					++m_Epoch;
+				}
+				++i;
+			}
+		}
+		return m_Epoch;
+	}
+
+private:
+	mutable unsigned int m_Epoch = 0;
+	mutable std::vector<int> m_VarValues;
+};
+
 class CostCalculator
 {
 public:
@@ -88,19 +710,28 @@ public:
 	void set_cost(int _terrain_id, int _cost)
 	{
 		if (0 < _cost)
+		{
 			m_CostMap.insert_or_assign(IdData<data_type>{_terrain_id, _cost});
+			m_Epoch.bump();
+		}
 	}
 
 	void set_cost_var(int _terrain_id, int _id)
 	{
 		if (0 < _id)
+		{
 			m_CostMap.insert_or_assign(IdData<data_type>{_terrain_id, -_id});
+			m_Epoch.bump();
+		}
 	}
 	
 	void reset_cost(int _terrain_id)
 	{
 		if (auto itr = m_CostMap.find(_terrain_id); itr != std::end(m_CostMap))
+		{
 			m_CostMap.erase(itr);
+			m_Epoch.bump();
+		}
 	}
 	
 	int get_cost(int _terrain_id) const
@@ -118,38 +749,59 @@ public:
 	void clear()
 	{
 		m_CostMap.clear();
+		m_Epoch.bump();
 	}
 
-	friend std::ostream& operator <<(std::ostream& _out, const CostCalculator& _obj)
+	unsigned int epoch() const
 	{
-		auto& data = _obj.m_CostMap;
-		_out << std::size(data) << " ";
-		std::for_each(std::begin(data), std::end(data),
-			[&_out](const auto& _el) { _out << std::get<0>(_el) << " " << std::get<1>(_el) << " "; }	
-		);
-		return _out;
+		return m_Epoch.get(m_CostMap, [](const auto& _el) { return std::get<1>(_el); });
 	}
 
-	friend std::istream& operator >>(std::istream& _in, CostCalculator& _obj)
+	// replaces all costs at once; later entries win over earlier ones with the same terrain ID
+	void assign(std::vector<IdData<data_type>> _costs)
 	{
-		auto& data = _obj.m_CostMap;
-		data.clear();
-		std::size_t size = 0;
-		_in >> size;
-		data.reserve(size);
+		std::stable_sort(std::begin(_costs), std::end(_costs), IdLess{});
+		m_CostMap.clear();
+		m_CostMap.reserve(std::size(_costs));
+		// sorted input is always appended, thus nothing has to be moved around
+		for (auto& cost : _costs)
+			m_CostMap.insert_or_assign(cost);
+		m_Epoch.bump();
+	}
+
+	void write(BinaryWriter& _writer) const
+	{
+		_writer.write_u32(static_cast<std::uint32_t>(std::size(m_CostMap)));
+		for (auto& [id, value] : m_CostMap)
+		{
+			_writer.write_i32(id);
+			_writer.write_i32(value);
+		}
+	}
+
+	bool read(BinaryReader& _reader)
+	{
+		m_CostMap.clear();
+		m_Epoch.bump();
+		std::uint32_t size = 0;
+		if (!_reader.read_count(size, 8))
+			return false;
 
-		for (std::size_t i = 0; i < size; ++i)
+		m_CostMap.reserve(size);
+		for (std::uint32_t i = 0; i < size; ++i)
 		{
-			int id;
-			int val;
-			_in >> id >> val;
-			data.insert(IdData<data_type>{id, val});
+			std::int32_t id = 0;
+			std::int32_t value = 0;
+			if (!_reader.read_i32(id) || !_reader.read_i32(value))
+				return false;
+			m_CostMap.insert_or_assign(IdData<data_type>{ id, value });
 		}
-		return _in;
+		return true;
 	}
 	
 private:
 	IdDataSortedVector<data_type> m_CostMap;
+	CostEpoch m_Epoch;
 };
 
 class EdgeCostCalculator
@@ -190,19 +842,28 @@ public:
 	void set_cost(int _from_terrain_id, int _to_terrain_id, int _cost)
 	{
 		if (0 < _cost)
+		{
 			m_Costs.insert_or_assign(Cost{ { _from_terrain_id, _to_terrain_id }, _cost });
+			m_Epoch.bump();
+		}
 	}
 
 	void set_cost_var(int _from_terrain_id, int _to_terrain_id, int _id)
 	{
 		if (0 < _id)
+		{
 			m_Costs.insert_or_assign(Cost{ { _from_terrain_id, _to_terrain_id }, -_id });
+			m_Epoch.bump();
+		}
 	}
 	
 	void reset_cost(int _from_terrain_id, int _to_terrain_id)
 	{
 		if (auto itr = m_Costs.find(CostKey{ _from_terrain_id, _to_terrain_id }); itr != std::end(m_Costs))
+		{
 			m_Costs.erase(itr);
+			m_Epoch.bump();
+		}
 	}
 	
 	int get_cost(int _from_terrain_id, int _to_terrain_id) const
@@ -220,172 +881,242 @@ public:
 	void clear()
 	{
 		m_Costs.clear();
+		m_Epoch.bump();
 	}
 
-	//friend std::ostream& operator <<(std::ostream& _out, const CostCalculator& _obj)
-	//{
-	//	auto& data = _obj.m_CostMap;
-	//	_out << std::size(data) << " ";
-	//	std::for_each(std::begin(data), std::end(data),
-	//		[&_out](const auto& _el) { _out << std::get<0>(_el) << " " << std::get<1>(_el) << " "; }	
-	//	);
-	//	return _out;
-	//}
-
-	//friend std::istream& operator >>(std::istream& _in, CostCalculator& _obj)
-	//{
-	//	auto& data = _obj.m_CostMap;
-	//	data.clear();
-	//	std::size_t size = 0;
-	//	_in >> size;
-	//	data.reserve(size);
-
-	//	for (std::size_t i = 0; i < size; ++i)
-	//	{
-	//		int id;
-	//		int val;
-	//		_in >> id >> val;
-	//		data.insert(IdData<data_type>{id, val});
-	//	}
-	//	return _in;
-	//}
+	unsigned int epoch() const
+	{
+		return m_Epoch.get(m_Costs, [](const Cost& _el) { return _el.cost; });
+	}
+
+	void write(BinaryWriter& _writer) const
+	{
+		_writer.write_u32(static_cast<std::uint32_t>(std::size(m_Costs)));
+		for (auto& cost : m_Costs)
+		{
+			_writer.write_i32(cost.key.first);
+			_writer.write_i32(cost.key.second);
+			_writer.write_i32(cost.cost);
+		}
+	}
+
+	bool read(BinaryReader& _reader)
+	{
+		m_Costs.clear();
+		m_Epoch.bump();
+		std::uint32_t size = 0;
+		if (!_reader.read_count(size, 12))
+			return false;
+
+		m_Costs.reserve(size);
+		for (std::uint32_t i = 0; i < size; ++i)
+		{
+			Cost cost{};
+			if (!_reader.read_i32(cost.key.first) || !_reader.read_i32(cost.key.second) || !_reader.read_i32(cost.cost))
+				return false;
+			m_Costs.insert_or_assign(cost);
+		}
+		return true;
+	}
 	
 private:
 	sl::container::SortedVector<Cost, CostKeyLess> m_Costs;
+	CostEpoch m_Epoch;
 };
 
 inline static CostCalculator globalCostCalculator;
 inline static EdgeCostCalculator globalEdgeCostCalculator;
 
-bool is_valid_pos(const Vector& _at)
+// both epochs are only growing, thus their sum changes whenever any of them changes
+inline unsigned int get_cost_epoch()
 {
-	assert(RPG::map);
-	auto& map = *RPG::map;
-	return 0 <= _at.x && _at.x < map.getWidth() &&
-		0 <= _at.y && _at.y < map.getHeight();
+	return globalCostCalculator.epoch() + globalEdgeCostCalculator.epoch();
+}
+
+// characters of the same class obey the same movement rules, thus they are able to share their paths
+inline int get_passability_class(const RPG::Character& _character)
+{
+	int vehicle = RPG::HV_NONE;
+	if (&_character == RPG::hero)
+		vehicle = RPG::hero->vehicle;
+	else if (&_character == RPG::vehicleSkiff || &_character == RPG::vehicleShip || &_character == RPG::vehicleAirship)
+		vehicle = static_cast<const RPG::Vehicle&>(_character).type;
+	return vehicle << 4 | _character.layer << 2 | _character.forbidEventOverlap << 1 | _character.phasing;
 }
 
-class Pathfinder
+struct PathRequestKey
+{
+	Vector start;
+	Vector end;
+	int passabilityClass = 0;
+	unsigned int costEpoch = 0;
+	unsigned int mapEpoch = 0;
+
+	friend bool operator ==(const PathRequestKey& _lhs, const PathRequestKey& _rhs)
+	{
+		return _lhs.start == _rhs.start && _lhs.end == _rhs.end &&
+			_lhs.passabilityClass == _rhs.passabilityClass && _lhs.costEpoch == _rhs.costEpoch && _lhs.mapEpoch == _rhs.mapEpoch;
+	}
+};
+
+struct PathRequestKeyHash
+{
+	std::size_t operator ()(const PathRequestKey& _key) const
+	{
+		std::size_t hash = 0;
+		for (auto value : { _key.start.x, _key.start.y, _key.end.x, _key.end.y, _key.passabilityClass,
+			static_cast<int>(_key.costEpoch), static_cast<int>(_key.mapEpoch) })
+			hash = hash * 31 + std::hash<int>{}(value);
+		return hash;
+	}
+};
+
+inline PathRequestKey make_request_key(const RPG::Character& _character, const Vector& _end)
+{
+	return { { _character.x, _character.y }, _end, get_passability_class(_character), get_cost_epoch(), globalMapEpoch };
+}
+
+/* Remembers the results of the current frame, thus identical requests (e.g. of parallel process pages) will be calculated only once.
+ * Unreachable destinations are remembered, too. */
+class PathCoalescer
 {
 public:
-	std::optional<int> calc_path(const Vector& _end, RPG::Character& _character)
+	std::optional<PathPtr> find(const PathRequestKey& _key)
 	{
-		Vector start{ _character.x, _character.y };
+		_refresh();
+		auto itr = std::find_if(std::begin(m_Entries), std::end(m_Entries), [&_key](const auto& _entry) { return _entry.first == _key; });
+		if (itr != std::end(m_Entries))
+			return itr->second;
+		return std::nullopt;
+	}
 
-		struct VectorLess
-		{
-			bool operator ()(const Vector& _lhs, const Vector& _rhs) const
-			{
-				return _lhs.x < _rhs.x || (_lhs.x == _rhs.x && _lhs.y < _rhs.y);
-			}
-		};
+	void insert(const PathRequestKey& _key, PathPtr _path)
+	{
+		_refresh();
+		m_Entries.emplace_back(_key, std::move(_path));
+	}
 
-		auto costCalculator = [](const Vector& _pos)
-		{
-			auto tileId = RPG::map->getLowerLayerTileId(_pos.x, _pos.y);
-			return globalCostCalculator.get_cost(RPG::map->getTerrainId(tileId));
-			//return RPG::map->getTerrainId(tileId);
-		};
+	void clear()
+	{
+		m_Entries.clear();
+	}
 
-		auto edgeCostCalculator = [](const Vector& _from, const Vector& _to)
-		{
-			auto fromTerrainId = RPG::map->getTerrainId(RPG::map->getLowerLayerTileId(_from.x, _from.y));
-			auto toTerrainId = RPG::map->getTerrainId(RPG::map->getLowerLayerTileId(_to.x, _to.y));
-			return globalEdgeCostCalculator.get_cost(fromTerrainId, toTerrainId);
-			//return RPG::map->getTerrainId(tileId);
-		};
-		
-		auto heuristicCalculator = [](const Vector& _pos, const Vector& _dest)
-		{
-			auto diff = _dest - _pos;
-			return std::abs(diff.x) + std::abs(diff.y);
-		};
+private:
+	int m_Frame = -1;
+	std::vector<std::pair<PathRequestKey, PathPtr>> m_Entries;
 
-		auto neighbourSearcher = [&_character](const auto& _node, auto&& _callback)
+	void _refresh()
+	{
+		if (m_Frame != RPG::system->frameCounter)
 		{
-			for (int i = 0; i < 4; ++i)
-			{
-				Vector dir{ 0, 0 };
-				switch (i)
-				{
-				case 0: dir.x = 1; break;
-				case 1: dir.x = -1; break;
-				case 2: dir.y = 1; break;
-				case 3: dir.y = -1; break;
-				}
-				auto at = _node.vertex + dir;
-				if (is_valid_pos(at) && _character.isMovePossible(_node.vertex.x, _node.vertex.y, at.x, at.y))
-					_callback(at);
-			}
-		};
+			m_Frame = RPG::system->frameCounter;
+			m_Entries.clear();
+		}
+	}
+};
+
+inline static PathCoalescer globalPathCoalescer;
+
+/* Bounded cache of found paths, which outlives the frame. The least recently used entries will be dropped first.
+ * Unreachable destinations aren't cached, because they are usually caused by characters which will move away soon. */
+class PathCache
+{
+public:
+	void set_capacity(std::size_t _capacity)
+	{
+		m_Capacity = _capacity;
+		_shrink();
+	}
 
-		class TableVisitationTracker
+	PathPtr find(const PathRequestKey& _key)
+	{
+		if (auto itr = m_Index.find(_key); itr != std::end(m_Index))
 		{
-		public:
-			TableVisitationTracker(std::size_t _width, std::size_t _height) :
-				m_Tracker{ _width, _height }
-			{
-			}
-			
-			decltype(auto) operator [](const Vector& _at)
-			{
-				return m_Tracker[_at.x][_at.y];
-			}
-			
-		private:
-			sl::container::Vector2d<bool> m_Tracker;
-		};
+			++m_Hits;
+			m_Entries.splice(std::begin(m_Entries), m_Entries, itr->second);
+			return itr->second->second;
+		}
+		++m_Misses;
+		return nullptr;
+	}
+
+	void insert(const PathRequestKey& _key, PathPtr _path)
+	{
+		assert(_path);
+		if (m_Capacity == 0)
+			return;
 
-		using Node = sl::graph::AStarNode<Vector, int>;
-		struct NodeVectorLess
+		if (auto itr = m_Index.find(_key); itr != std::end(m_Index))
 		{
-			bool operator ()(const Node& _lhs, const Node& _rhs) const
-			{
-				return VectorLess{}(_lhs.vertex, _rhs.vertex);
-			}
+			itr->second->second = std::move(_path);
+			m_Entries.splice(std::begin(m_Entries), m_Entries, itr->second);
+			return;
+		}
+		m_Entries.emplace_front(_key, std::move(_path));
+		m_Index.emplace(_key, std::begin(m_Entries));
+		_shrink();
+	}
 
-			bool operator ()(const Node& _lhs, const Vector& _rhs) const
-			{
-				return VectorLess{}(_lhs.vertex, _rhs);
-			}
+	void clear()
+	{
+		m_Entries.clear();
+		m_Index.clear();
+	}
 
-			bool operator ()(const Vector& _lhs, const Node& _rhs) const
-			{
-				return VectorLess{}(_lhs, _rhs.vertex);
-			}
-		};
-		
-		sl::container::SortedVector<Node, NodeVectorLess> closedList;
-		sl::graph::traverse_astar(start, _end, neighbourSearcher,
-			TableVisitationTracker{ static_cast<std::size_t>(RPG::map->getWidth()), static_cast<std::size_t>(RPG::map->getHeight()) },
-			heuristicCalculator, costCalculator, edgeCostCalculator,
-			[&closedList](const Node& _node)
-			{
-				closedList.insert(_node);
-			}
-		);
-		
-		if (auto path = _extract_path(closedList, _end))
-			return globalPathMgr.insert_path(std::move(*path));
-		return std::nullopt;
+	unsigned int hits() const
+	{
+		return m_Hits;
 	}
-	
-private:
-	template <class TClosedList>
-	std::optional<Path> _extract_path(const TClosedList& _closedList, Vector _end)
+
+	unsigned int misses() const
 	{
-		Path path;
-		auto itr = _closedList.find(_end);
-		if (itr == std::end(_closedList))
-			return std::nullopt;
+		return m_Misses;
+	}
 
-		path.emplace_back(itr->vertex);
-		while (itr->parent)
+private:
+	using Entry = std::pair<PathRequestKey, PathPtr>;
+
+	std::size_t m_Capacity = 64;
+	unsigned int m_Hits = 0;
+	unsigned int m_Misses = 0;
+	std::list<Entry> m_Entries;
+	std::unordered_map<PathRequestKey, std::list<Entry>::iterator, PathRequestKeyHash> m_Index;
+
+	void _shrink()
+	{
+		while (m_Capacity < std::size(m_Entries))
 		{
-			path.emplace_back(*itr->parent);
-			itr = _closedList.find(*itr->parent);
+			m_Index.erase(m_Entries.back().first);
+			m_Entries.pop_back();
 		}
-		std::reverse(std::begin(path), std::end(path));
-		return path;
 	}
 };
+
+inline static PathCache globalPathCache;
+
+// looks up results of identical requests; an empty path means, that the destination is known to be unreachable
+inline std::optional<PathPtr> find_known_path(const PathRequestKey& _key)
+{
+	if (auto entry = globalPathCoalescer.find(_key))
+		return entry;
+	if (auto path = globalPathCache.find(_key))
+		return path;
+	return std::nullopt;
+}
+
+inline void remember_path(const PathRequestKey& _key, const PathPtr& _path)
+{
+	globalPathCoalescer.insert(_key, _path);
+	if (_path)
+		globalPathCache.insert(_key, _path);
+}
+
+bool is_valid_pos(const Vector& _at)
+{
+	assert(RPG::map);
+	auto& map = *RPG::map;
+	return 0 <= _at.x && _at.x < map.getWidth() &&
+		0 <= _at.y && _at.y < map.getHeight();
+}
+
+#endif
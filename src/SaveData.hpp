@@ -0,0 +1,100 @@
+#ifndef DYNRPG_PATHFINDER_SAVE_DATA_HPP
+#define DYNRPG_PATHFINDER_SAVE_DATA_HPP
+
+#pragma once
+
+#include "Binary.hpp"
+#include "Pathfinding.hpp"
+#include "Settings.hpp"
+
+#include <charconv>
+#include <cstring>
+
+/* Layout (little-endian):
+ *	magic "PFSV", u32 version, u32 flags
+ *	terrain costs:			u32 count, { i32 terrain id, i32 cost }
+ *	terrain travel costs:	u32 count, { i32 from terrain id, i32 to terrain id, i32 cost }
+ *	paths (flag):			u32 count, { i32 id, i32 character, i32 owner, i32 group (since version 2), u32 walked steps, compact path }
+ * Costs bound to variables are stored as negative variable IDs, just like internally.
+ * Saves of older plugin versions consist of the terrain costs as plain text. */
+namespace save_data
+{
+	inline constexpr char magic[4] = { 'P', 'F', 'S', 'V' };
+	inline constexpr std::uint32_t version = 2;
+	inline constexpr std::uint32_t flagPaths = 1;
+
+	inline bool is_binary(const char* _data, std::size_t _size)
+	{
+		return sizeof magic <= _size && std::memcmp(_data, magic, sizeof magic) == 0;
+	}
+
+	inline BinaryWriter write()
+	{
+		BinaryWriter writer;
+		std::uint32_t flags = globalSettings.savePaths ? flagPaths : 0;
+		writer.write_bytes(magic, sizeof magic);
+		writer.write_u32(version);
+		writer.write_u32(flags);
+		globalCostCalculator.write(writer);
+		globalEdgeCostCalculator.write(writer);
+		if (flags & flagPaths)
+			globalPathMgr.write(writer);
+		return writer;
+	}
+
+	// the legacy format: "count id cost id cost ..." separated by whitespace
+	inline bool read_legacy(const char* _data, std::size_t _size)
+	{
+		auto itr = _data;
+		auto end = _data + _size;
+		auto next_int = [&itr, end](int& _value)
+		{
+			while (itr != end && (*itr == ' ' || *itr == '\t' || *itr == '\r' || *itr == '\n'))
+				++itr;
+			auto result = std::from_chars(itr, end, _value);
+			itr = result.ptr;
+			return result.ec == std::errc{};
+		};
+
+		std::vector<IdData<CostCalculator::data_type>> costs;
+		int count = 0;
+		bool success = next_int(count) && 0 <= count && static_cast<std::size_t>(count) <= _size / 4;
+		if (success)
+		{
+			costs.reserve(static_cast<std::size_t>(count));
+			for (int i = 0; i < count && success; ++i)
+			{
+				int id = 0;
+				int cost = 0;
+				success = next_int(id) && next_int(cost);
+				if (success)
+					costs.emplace_back(id, cost);
+			}
+		}
+		globalCostCalculator.assign(std::move(costs));
+		globalEdgeCostCalculator.clear();
+		return success;
+	}
+
+	/* Nothing of the previous session survives, even if the header can't be read; everything which has been read until an
+	 * error occurs is kept. */
+	inline bool read(const char* _data, std::size_t _size)
+	{
+		BinaryReader reader{ _data, _size };
+		char fileMagic[sizeof magic];
+		std::uint32_t fileVersion = 0;
+		std::uint32_t flags = 0;
+		globalCostCalculator.clear();
+		globalEdgeCostCalculator.clear();
+		globalPathMgr.discard_pending();
+		if (!reader.read_bytes(fileMagic, sizeof fileMagic) || !reader.read_u32(fileVersion) || version < fileVersion ||
+			!reader.read_u32(flags))
+			return false;
+
+		return globalCostCalculator.read(reader) &&
+			globalEdgeCostCalculator.read(reader) &&
+			(!(flags & flagPaths) || globalPathMgr.read(reader, fileVersion));
+	}
+}
+
+#endif
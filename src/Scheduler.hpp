@@ -0,0 +1,227 @@
+#ifndef DYNRPG_PATHFINDER_SCHEDULER_HPP
+#define DYNRPG_PATHFINDER_SCHEDULER_HPP
+
+#pragma once
+
+#include "Pathfinder.hpp"
+#include "Settings.hpp"
+#include "WorkerPool.hpp"
+
+#include <queue>
+
+enum class TicketState
+{
+	unknown,
+	pending,
+	finished
+};
+
+class PathRequestScheduler
+{
+public:
+	struct Result
+	{
+		TicketState state = TicketState::unknown;
+		std::optional<int> pathId;
+	};
+
+	int enqueue(RPG::Character& _character, const Vector& _end, int _readySwitch)
+	{
+		_sync_map_epoch();
+		auto ticket = m_NextTicket++;
+		m_Queue.push(Request{ ticket, _calc_priority(_character), m_NextSequence++, &_character, _end, _readySwitch });
+		m_Tickets.insert(TicketNode{ ticket, Result{ TicketState::pending, std::nullopt } });
+		_set_switch(_readySwitch, false);
+		return ticket;
+	}
+
+	/* At least one request will be processed per call, thus even a budget of 0 guarantees progress.
+	 * When the worker pool is running, requests are just handed over to it and the budget is spent on taking the snapshots. */
+	void process(std::chrono::microseconds _budget)
+	{
+		_sync_map_epoch();
+		_collect_results();
+
+		auto deadline = std::chrono::steady_clock::now() + _budget;
+		while (!std::empty(m_Queue))
+		{
+			auto request = m_Queue.top();
+			m_Queue.pop();
+			if (!_is_pending(request.ticket))
+				continue;
+
+			if (globalWorkerPool.is_running())
+				_dispatch(request);
+			else
+			{
+				Pathfinder p;
+				_finish(request.ticket, request.readySwitch, p.calc_path(request.end, *request.character));
+			}
+
+			if (deadline <= std::chrono::steady_clock::now())
+				break;
+		}
+	}
+
+	// finished tickets will be released by this call; pending tickets stay untouched
+	Result take_result(int _ticket)
+	{
+		_sync_map_epoch();
+		auto itr = m_Tickets.find(_ticket);
+		if (itr == std::end(m_Tickets))
+			return Result{};
+
+		auto result = std::get<Result>(*itr);
+		if (result.state == TicketState::finished)
+			m_Tickets.erase(itr);
+		return result;
+	}
+
+	/* Queued requests are skipped and results of jobs in flight are dropped on arrival. The path of a finished ticket
+	 * is cleared, because nobody is going to ask for its ID anymore. */
+	bool cancel(int _ticket)
+	{
+		_sync_map_epoch();
+		auto itr = m_Tickets.find(_ticket);
+		if (itr == std::end(m_Tickets))
+			return false;
+
+		auto& result = std::get<Result>(*itr);
+		if (result.state == TicketState::finished && result.pathId)
+			globalPathMgr.clear_path(*result.pathId);
+		m_Tickets.erase(itr);
+		return true;
+	}
+
+private:
+	using TicketNode = IdData<Result>;
+
+	struct Request
+	{
+		int ticket;
+		int priority;
+		unsigned int sequence;
+		RPG::Character* character;
+		Vector end;
+		int readySwitch;
+	};
+
+	// lower priority values will be served first; equal priorities are served in order of arrival
+	struct RequestLater
+	{
+		bool operator ()(const Request& _lhs, const Request& _rhs) const
+		{
+			return _rhs.priority < _lhs.priority ||
+				(_lhs.priority == _rhs.priority && _rhs.sequence < _lhs.sequence);
+		}
+	};
+
+	int m_NextTicket = 1;
+	unsigned int m_NextSequence = 0;
+	unsigned int m_MapEpoch = 0;
+	std::priority_queue<Request, std::vector<Request>, RequestLater> m_Queue;
+	IdDataSortedVector<Result> m_Tickets;
+
+	/* Requests refer to characters of the map they have been made on, thus they are dropped as soon as the map has changed.
+	 * Results of jobs which are still in flight will be dropped on arrival. Ticket numbers keep growing, thus tickets of
+	 * the previous map are reported as unknown. */
+	void _sync_map_epoch()
+	{
+		if (m_MapEpoch != update_map_epoch())
+		{
+			m_MapEpoch = globalMapEpoch;
+			m_Queue = {};
+			m_Tickets.clear();
+		}
+	}
+
+	bool _is_pending(int _ticket) const
+	{
+		auto itr = m_Tickets.find(_ticket);
+		return itr != std::end(m_Tickets) && std::get<Result>(*itr).state == TicketState::pending;
+	}
+
+	static void _set_switch(int _index, bool _value)
+	{
+		if (0 < _index)
+			RPG::system->switches[_index] = _value;
+	}
+
+	void _finish(int _ticket, int _readySwitch, std::optional<int> _pathId)
+	{
+		m_Tickets.insert_or_assign(TicketNode{ _ticket, Result{ TicketState::finished, _pathId } });
+		_set_switch(_readySwitch, true);
+	}
+
+	void _dispatch(const Request& _request)
+	{
+		auto& character = *_request.character;
+		auto key = make_request_key(character, _request.end);
+		if (auto entry = find_known_path(key))
+		{
+			_finish(_request.ticket, _request.readySwitch, *entry ? std::optional<int>{ globalPathMgr.insert_path(std::move(*entry), &character) } : std::nullopt);
+			return;
+		}
+
+		if (auto precomputedPath = find_precomputed_path(character, key))
+		{
+			auto path = std::make_shared<const CompactPath>(*precomputedPath);
+			remember_path(key, path);
+			_finish(_request.ticket, _request.readySwitch, globalPathMgr.insert_path(std::move(path), &character));
+			return;
+		}
+
+		globalWorkerPool.submit(PathJob{ _request.ticket, _request.readySwitch, m_MapEpoch, &character, key, globalSnapshotProvider.get(character) });
+	}
+
+	void _collect_results()
+	{
+		while (auto result = globalWorkerPool.poll_result())
+		{
+			if (result->mapEpoch != m_MapEpoch)
+				continue;
+
+			// the result is still worth to be cached, even if its ticket has been cancelled
+			PathPtr path;
+			if (result->path)
+				path = std::make_shared<const CompactPath>(*result->path);
+			remember_path(result->key, path);
+			if (!_is_pending(result->ticket))
+				continue;
+			_finish(result->ticket, result->readySwitch, path ? std::optional<int>{ globalPathMgr.insert_path(std::move(path), result->character) } : std::nullopt);
+		}
+	}
+
+	static int _calc_priority(RPG::Character& _character)
+	{
+		Vector pos{ _character.x, _character.y };
+		switch (globalSettings.schedulePriority)
+		{
+		case SchedulePriority::screen:
+			return _distance_to_screen(pos);
+		case SchedulePriority::hero:
+		default:
+			return (Vector{ RPG::hero->x, RPG::hero->y } - pos).manhattan_length();
+		}
+	}
+
+	// the visible area covers 20x15 tiles; characters inside of it share the highest priority
+	static int _distance_to_screen(const Vector& _pos)
+	{
+		auto left = RPG::map->getCameraX() / 16;
+		auto top = RPG::map->getCameraY() / 16;
+		auto dist = [](int _value, int _min, int _max)
+		{
+			if (_value < _min)
+				return _min - _value;
+			if (_max < _value)
+				return _value - _max;
+			return 0;
+		};
+		return dist(_pos.x, left, left + 19) + dist(_pos.y, top, top + 14);
+	}
+};
+
+inline static PathRequestScheduler globalScheduler;
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef DYNRPG_PATHFINDER_SETTINGS_HPP
+#define DYNRPG_PATHFINDER_SETTINGS_HPP
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <stdexcept>
+#include <thread>
+
+enum class SchedulePriority
+{
+	hero,
+	screen
+};
+
+struct Settings
+{
+	std::chrono::microseconds frameBudget{ 2000 };
+	SchedulePriority schedulePriority = SchedulePriority::hero;
+	int workerThreads = -1;		// negative values let the plugin decide
+	std::size_t cacheSize = 64;
+	std::size_t allPairsMaxTiles = 0;		// 0 disables the all-pairs table
+	std::size_t allPairsMaxBytes = 4096 * 1024;
+	std::size_t pathMemoryMaxBytes = 0;		// 0 disables the limit
+	bool savePaths = true;
+	int errorVariable = 0;		// receives the status of each command; 0 disables it
+	int errorSwitch = 0;		// turned on, if a command has failed; 0 disables it
+
+	// one core is always left for the game itself
+	unsigned int worker_count() const
+	{
+		if (0 <= workerThreads)
+			return static_cast<unsigned int>(workerThreads);
+		auto cores = std::thread::hardware_concurrency();
+		if (cores <= 1)
+			return 0;
+		return cores - 1 < 4 ? cores - 1 : 4;
+	}
+
+	// keys which aren't known are silently ignored, because the section also contains the terrain cost table
+	void load(const std::map<std::string, std::string>& _config)
+	{
+		for (auto&[key, value] : _config)
+		{
+			try
+			{
+				if (key == "frame_budget_us")
+				{
+					auto us = std::stoi(value);
+					frameBudget = std::chrono::microseconds{ us < 0 ? 0 : us };
+				}
+				else if (key == "schedule_priority")
+					schedulePriority = value == "screen" ? SchedulePriority::screen : SchedulePriority::hero;
+				else if (key == "worker_threads")
+					workerThreads = std::stoi(value);
+				else if (key == "cache_size")
+					cacheSize = _to_size(value);
+				else if (key == "all_pairs_max_tiles")
+					allPairsMaxTiles = _to_size(value);
+				else if (key == "all_pairs_max_memory_kb")
+					allPairsMaxBytes = _to_size(value) * 1024;
+				else if (key == "path_memory_max_kb")
+					pathMemoryMaxBytes = _to_size(value) * 1024;
+				else if (key == "save_paths")
+					savePaths = std::stoi(value) != 0;
+				else if (key == "error_variable")
+					errorVariable = std::stoi(value);
+				else if (key == "error_switch")
+					errorSwitch = std::stoi(value);
+			}
+			catch (const std::logic_error&)
+			{}
+		}
+	}
+
+private:
+	static std::size_t _to_size(const std::string& _value)
+	{
+		auto value = std::stoi(_value);
+		return value < 0 ? 0 : static_cast<std::size_t>(value);
+	}
+};
+
+inline static Settings globalSettings;
+
+#endif
@@ -81,4 +81,26 @@ public:
     }
 };
 
+// ordered like RPG::Direction; the first four are the straight ones
+inline static const Vector directionOffsets[] = {
+    { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 },
+    { 1, -1 }, { 1, 1 }, { -1, 1 }, { -1, -1 }
+};
+
+// returns -1 if the offset doesn't lead to an adjacent tile
+inline int direction_of(const Vector& _offset)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        if (directionOffsets[i] == _offset)
+            return i;
+    }
+    return -1;
+}
+
+inline int opposite_direction(int _dir)
+{
+    return _dir < 4 ? (_dir + 2) % 4 : 4 + (_dir - 2) % 4;
+}
+
 #endif
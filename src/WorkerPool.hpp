@@ -0,0 +1,198 @@
+#ifndef DYNRPG_PATHFINDER_WORKER_POOL_HPP
+#define DYNRPG_PATHFINDER_WORKER_POOL_HPP
+
+#pragma once
+
+#include "MapSnapshot.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/* Lock-free multi producer, single consumer queue (Dmitry Vyukov's design).
+ * push may be called from any thread, pop only from the consuming one. */
+template <class T>
+class MpscQueue
+{
+public:
+	MpscQueue() :
+		m_Head{ new Node },
+		m_Tail{ m_Head.load() }
+	{
+	}
+
+	~MpscQueue()
+	{
+		while (pop())
+			;
+		delete m_Tail;
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator =(const MpscQueue&) = delete;
+
+	void push(T _value)
+	{
+		auto node = new Node;
+		node->value = std::move(_value);
+		auto prev = m_Head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	std::optional<T> pop()
+	{
+		auto next = m_Tail->next.load(std::memory_order_acquire);
+		if (!next)
+			return std::nullopt;
+
+		auto value = std::move(next->value);
+		delete m_Tail;
+		m_Tail = next;
+		return value;
+	}
+
+private:
+	struct Node
+	{
+		std::atomic<Node*> next{ nullptr };
+		std::optional<T> value;
+	};
+
+	std::atomic<Node*> m_Head;
+	Node* m_Tail;
+};
+
+struct PathJob
+{
+	int ticket = 0;
+	int readySwitch = 0;
+	unsigned int mapEpoch = 0;
+	RPG::Character* character = nullptr;		// never touched by the workers
+	PathRequestKey key;
+	MapSnapshotPtr snapshot;
+};
+
+struct PathJobResult
+{
+	int ticket = 0;
+	int readySwitch = 0;
+	unsigned int mapEpoch = 0;
+	RPG::Character* character = nullptr;		// never touched by the workers
+	PathRequestKey key;
+	std::optional<Path> path;
+};
+
+/* Searches paths on snapshots in the background. Workers never touch any RPG object; everything they need is part of the job.
+ * Results are published through a lock-free queue, which has to be drained by the main thread. Other background work may be
+ * posted as tasks, which are only served while no path job is waiting. */
+class PathWorkerPool
+{
+public:
+	~PathWorkerPool()
+	{
+		stop();
+	}
+
+	bool is_running() const
+	{
+		return !std::empty(m_Threads);
+	}
+
+	void start(std::size_t _count)
+	{
+		stop();
+		m_Stop = false;
+		for (std::size_t i = 0; i < _count; ++i)
+			m_Threads.emplace_back([this] { _run(); });
+	}
+
+	// pending jobs are dropped; results which are already published stay available
+	void stop()
+	{
+		{
+			std::lock_guard lock{ m_JobMx };
+			m_Stop = true;
+			m_Jobs.clear();
+			m_Tasks.clear();
+		}
+		m_JobCv.notify_all();
+		for (auto& thread : m_Threads)
+			thread.join();
+		m_Threads.clear();
+	}
+
+	void submit(PathJob _job)
+	{
+		{
+			std::lock_guard lock{ m_JobMx };
+			m_Jobs.emplace_back(std::move(_job));
+		}
+		m_JobCv.notify_one();
+	}
+
+	void post(std::function<void()> _task)
+	{
+		{
+			std::lock_guard lock{ m_JobMx };
+			m_Tasks.emplace_back(std::move(_task));
+		}
+		m_JobCv.notify_one();
+	}
+
+	std::optional<PathJobResult> poll_result()
+	{
+		return m_Results.pop();
+	}
+
+private:
+	std::vector<std::thread> m_Threads;
+	std::mutex m_JobMx;
+	std::condition_variable m_JobCv;
+	std::deque<PathJob> m_Jobs;
+	std::deque<std::function<void()>> m_Tasks;
+	bool m_Stop = false;
+	MpscQueue<PathJobResult> m_Results;
+
+	void _run()
+	{
+		while (true)
+		{
+			std::optional<PathJob> job;
+			std::function<void()> task;
+			{
+				std::unique_lock lock{ m_JobMx };
+				m_JobCv.wait(lock, [this] { return m_Stop || !std::empty(m_Jobs) || !std::empty(m_Tasks); });
+				if (m_Stop)
+					return;
+				if (!std::empty(m_Jobs))
+				{
+					job = std::move(m_Jobs.front());
+					m_Jobs.pop_front();
+				}
+				else
+				{
+					task = std::move(m_Tasks.front());
+					m_Tasks.pop_front();
+				}
+			}
+
+			if (task)
+			{
+				task();
+				continue;
+			}
+
+			auto path = search_path(*job->snapshot, job->key.start, job->key.end);
+			m_Results.push(PathJobResult{ job->ticket, job->readySwitch, job->mapEpoch, job->character, job->key, std::move(path) });
+		}
+	}
+};
+
+inline static PathWorkerPool globalWorkerPool;
+
+#endif
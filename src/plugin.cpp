@@ -2,18 +2,20 @@
 //#define CUSTOM_DLLMAIN
 //#define _GLIBCXX_USE_CXX11_ABI 0
 
-// ToDo: Clear the globalPathManager object on map change
-
 #include <DynRPG/DynRPG.h>
+#include <string>
 #include <string_view>
 #include <stdexcept>
-#include <charconv>
-#include <locale>
-#include <sstream>
+#include <array>
+#include <chrono>
 #include <unordered_map>
 
 #include "Vector.hpp"
-#include "Pathfinding.hpp"
+#include "Followers.hpp"
+#include "Pathfinder.hpp"
+#include "SaveData.hpp"
+#include "Scheduler.hpp"
+#include "Settings.hpp"
 
 struct RPGVariable
 {
@@ -25,11 +27,13 @@ struct RPGVariable
 		return nullptr;
 	}
 
-	static int& get(int _index)
+	// the variables array grows on access, thus touching the last element first keeps the whole range valid
+	static int* get_range(int _first, int _count)
 	{
-		if (auto ptr = get_ptr(_index))
-			return *ptr;
-		throw std::runtime_error("RPG::Variable index out of bounds.");
+		if (_first <= 0 || _count <= 0)
+			return nullptr;
+		get_ptr(_first + _count - 1);
+		return get_ptr(_first);
 	}
 };
 
@@ -43,427 +47,1307 @@ struct RPGSwitch
 		return nullptr;
 	}
 
-	static bool& get(int _index)
-	{
-		if (auto ptr = get_ptr(_index))
-			return *ptr;
-		throw std::runtime_error("RPG::Switch index out of bounds.");
-	}
+};
+
+// classification of a comment parameter, which doesn't change between executions of the same comment
+enum class ParamKind : std::uint8_t
+{
+	invalid,
+	number,
+	token,		// unknown token
+	hero,
+	skiff,
+	ship,
+	airship
 };
 
 struct Param
 {
-	static std::optional<int> get_integer(const RPG::ParsedCommentParameter& _param)
+	static constexpr std::size_t maxCompiledParams = 8;
+
+	// set while a compiled command is executed; parameters without descriptor will be classified on the fly
+	inline static const ParamKind* compiledKinds = nullptr;
+	inline static const RPG::ParsedCommentParameter* compiledParams = nullptr;
+
+	static ParamKind classify(const RPG::ParsedCommentParameter& _param)
 	{
 		switch (_param.type)
 		{
 		case RPG::PARAM_NUMBER:
-			return get_from_number<int>(_param);
-		/* It seems, the current DynRPG version already parses the values out of the token. So this is obsolete now?
+			return ParamKind::number;
 		case RPG::PARAM_TOKEN:
-			return lookup_value<int>(std::begin(_param.text), std::find(std::begin(_param.text), std::end(_param.text), 0));*/
+			return _find_character_token(token_of(_param));
 		default:
-			throw std::runtime_error("Invalid argument.");
+			return ParamKind::invalid;
 		}
 	}
 
-	static RPG::Character* get_character(const RPG::ParsedCommentParameter& _param)
+	// tokens are plain ASCII, thus there is no need to involve any locale
+	static constexpr char to_lower(char _c)
+	{
+		return 'A' <= _c && _c <= 'Z' ? static_cast<char>(_c - 'A' + 'a') : _c;
+	}
+
+	static constexpr bool equals_ignore_case(std::string_view _token, std::string_view _lowerName)
+	{
+		if (std::size(_token) != std::size(_lowerName))
+			return false;
+		for (std::size_t i = 0; i < std::size(_token); ++i)
+		{
+			if (to_lower(_token[i]) != _lowerName[i])
+				return false;
+		}
+		return true;
+	}
+
+	static std::string_view token_of(const RPG::ParsedCommentParameter& _param)
+	{
+		return { _param.text, static_cast<std::size_t>(std::find(std::begin(_param.text), std::end(_param.text), 0) - std::begin(_param.text)) };
+	}
+
+	static std::optional<int> get_integer(const RPG::ParsedCommentParameter& _param)
 	{
 		switch (_param.type)
 		{
+		// variable references like v1 or vv1 are already resolved by DynRPG, thus they arrive as numbers
 		case RPG::PARAM_NUMBER:
-			return RPG::map->events[_param.number];
-		case RPG::PARAM_TOKEN:
-			return lookup_value<RPG::Character*>(std::begin(_param.text), std::find(std::begin(_param.text), std::end(_param.text), 0)).value_or(nullptr);
+			return get_from_number<int>(_param);
 		default:
-			throw std::runtime_error("Invalid argument.");
+			return std::nullopt;
+		}
+	}
+
+	// nullptr, if the parameter doesn't refer to a valid variable
+	static int* get_variable(const RPG::ParsedCommentParameter& _param)
+	{
+		if (auto index = get_integer(_param))
+			return RPGVariable::get_ptr(*index);
+		return nullptr;
+	}
+
+	static bool* get_switch(const RPG::ParsedCommentParameter& _param)
+	{
+		if (auto index = get_integer(_param))
+			return RPGSwitch::get_ptr(*index);
+		return nullptr;
+	}
+
+	/* Touching a higher index may move all variables (or switches), thus pointers taken while the arguments were checked
+	 * might be dangling by the time a result is known. Outputs are resolved right before they are written instead. */
+	static void set_variable(const RPG::ParsedCommentParameter& _param, int _value)
+	{
+		if (auto var = get_variable(_param))
+			*var = _value;
+	}
+
+	static void set_switch(const RPG::ParsedCommentParameter& _param, bool _value)
+	{
+		if (auto sw = get_switch(_param))
+			*sw = _value;
+	}
+
+	static RPG::Character* get_character(const RPG::ParsedCommentParameter& _param)
+	{
+		switch (_kind_of(_param))
+		{
+		case ParamKind::number:
+			return globalCharacters.find_event(get_from_number<int>(_param));
+		case ParamKind::invalid:
+			return nullptr;
+		default:
+			return _character_of(_kind_of(_param));
 		}
 	}
 
 private:
+	static ParamKind _kind_of(const RPG::ParsedCommentParameter& _param)
+	{
+		if (compiledKinds && compiledParams <= &_param && &_param < compiledParams + maxCompiledParams)
+			return compiledKinds[&_param - compiledParams];
+		return classify(_param);
+	}
+
 	template <class TType>
 	static TType get_from_number(const RPG::ParsedCommentParameter& _param)
 	{
 		return static_cast<TType>(_param.number);
 	}
 
-	template <class TType, class TIterator>
-	static std::optional<TType> lookup_value(TIterator _itr, const TIterator& _end)
+	struct CharacterToken
 	{
-		std::string_view token(&*_itr, std::distance(_itr, _end));
-		if (std::empty(token))
-			return std::nullopt;
-
-		if constexpr (std::is_same_v<int, TType>)
-		{
-			auto valBegin = std::find_if_not(std::rbegin(token), std::rend(token), [](char _c) { return '0' <= _c && _c <= '9'; }).base();
-			if (valBegin == std::end(token))
-				return std::nullopt;
+		std::string_view name;
+		ParamKind kind;
+	};
 
-			int curIndex = 0;
-			auto result = std::from_chars(&*valBegin, token.data() + token.size(), curIndex);
-		    if (result.ec == std::errc::invalid_argument)
-		        return std::nullopt;
+	static constexpr CharacterToken characterTokens[] = {
+		{ "hero", ParamKind::hero },
+		{ "skiff", ParamKind::skiff },
+		{ "ship", ParamKind::ship },
+		{ "airship", ParamKind::airship }
+	};
 
-			try
-			{
-				for (auto itr = std::begin(token); itr != valBegin; ++itr)
-				{
-					if (std::tolower(*itr, std::locale()) != 'v')
-						return std::nullopt;
-					
-					curIndex = RPGVariable::get(curIndex);
-				}
-				return RPGVariable::get(curIndex);
-			}
-			catch (const std::runtime_error& _e)
-			{
-			}
-			return std::nullopt;
-		}
-		else if constexpr (std::is_same_v<bool, TType>)
+	static ParamKind _find_character_token(std::string_view _token)
+	{
+		for (auto& characterToken : characterTokens)
 		{
-			if (std::tolower(token[0], std::locale()) != 's')
-				return std::nullopt;
-
-			try
-			{
-				if (auto index = lookup_value<int>(_itr + 1, _end))
-					return RPGSwitch::get(index);
-			}
-			catch (const std::runtime_error& _e)
-			{
-			}
-			return std::nullopt;
+			if (equals_ignore_case(_token, characterToken.name))
+				return characterToken.kind;
 		}
-		else if constexpr (std::is_same_v<RPG::Character*, std::remove_cv_t<TType>>)
+		return ParamKind::token;
+	}
+
+	static RPG::Character* _character_of(ParamKind _kind)
+	{
+		switch (_kind)
 		{
-			std::string tokenStr(std::size(token), 0);
-			std::transform(std::begin(token), std::end(token), std::begin(tokenStr),
-				[](char _c){ return std::tolower(_c, std::locale()); }
-			);
-
-			if (tokenStr == "hero")
-				return RPG::hero;
-			if (tokenStr == "ship")
-				return RPG::vehicleShip;
-			if (tokenStr == "airship")
-				return RPG::vehicleAirship;
-			if (tokenStr == "skiff")
-				return RPG::vehicleSkiff;
-
-			// seems to be not necessary; let's just wait for the number
-			/*if (tokenStr[0] == 'n')
-			{
-				if (auto eventId = lookup_value<int>(std::begin(tokenStr) + 1, std::end(tokenStr)))
-					return RPG::map->events[*eventId];
-			}*/
+		case ParamKind::hero:
+			return RPG::hero;
+		case ParamKind::skiff:
+			return RPG::vehicleSkiff;
+		case ParamKind::ship:
+			return RPG::vehicleShip;
+		case ParamKind::airship:
+			return RPG::vehicleAirship;
+		default:
+			return nullptr;
 		}
-
-		return std::nullopt;		
 	}
 };
 
-struct ParamError : std::runtime_error
+// the parameters of a single command; within a batch, they are a slice of the comment's parameters
+struct CommandArgs
 {
-	explicit ParamError(const std::string& _what) : std::runtime_error{ _what } {}
-	explicit ParamError(const char* _what ) : std::runtime_error{ _what } {}
+	const RPG::ParsedCommentParameter* parameters = nullptr;
+	int parametersCount = 0;
 };
 
-void cmd_find_path(const char* _text, const RPG::ParsedCommentData* _parsedData)
+// status of a command; 0 means success, thus it can be tested directly by the scripts
+enum class CommandError
+{
+	none = 0,
+	paramCount = 1,
+	invalidParam = 2,
+	invalidVariable = 3,
+	invalidSwitch = 4
+};
+
+inline static CommandError globalLastError = CommandError::none;
+
+inline CommandError arg_error(const std::optional<int>& _value)
+{
+	return _value ? CommandError::none : CommandError::invalidParam;
+}
+
+inline CommandError arg_error(const int* _variable)
+{
+	return _variable ? CommandError::none : CommandError::invalidVariable;
+}
+
+inline CommandError arg_error(const bool* _switch)
+{
+	return _switch ? CommandError::none : CommandError::invalidSwitch;
+}
+
+// the first invalid argument determines the error
+template <class... TArgs>
+CommandError check_args(const TArgs&... _args)
+{
+	auto error = CommandError::none;
+	((error == CommandError::none ? void(error = arg_error(_args)) : void()), ...);
+	return error;
+}
+
+CommandError cmd_find_path(const char* _text, const CommandArgs& _args)
 {
 	//auto begin = std::chrono::steady_clock::now();
 
-	if (_parsedData->parametersCount != 5)
-		throw ParamError("cmd_find_path: Invalid param count.");
+	if (_args.parametersCount != 5)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto& outSuccess = RPGSwitch::get(Param::get_integer(params[4]).value());
-	outSuccess = false;
+	auto& params = _args.parameters;
+	auto x = Param::get_integer(params[1]);
+	auto y = Param::get_integer(params[2]);
+	auto outId = Param::get_variable(params[3]);
+	auto outSuccess = Param::get_switch(params[4]);
+	if (auto error = check_args(x, y, outId, outSuccess); error != CommandError::none)
+		return error;
 
+	Param::set_switch(params[4], false);
 	if (auto target = Param::get_character(params[0]))
 	{
+		// the search reads variable based costs, which may grow the variables
 		Pathfinder p;
-		auto x = Param::get_integer(params[1]).value();
-		auto y = Param::get_integer(params[2]).value();
-		auto& outId = RPGVariable::get(Param::get_integer(params[3]).value());
-		if (auto optId = p.calc_path({ x, y }, *target))
+		if (auto optId = p.calc_path({ *x, *y }, *target))
 		{
-			outId = *optId;
-			outSuccess = true;
+			Param::set_variable(params[3], *optId);
+			Param::set_switch(params[4], true);
 		}
 	}
 
 	//auto diff = std::chrono::steady_clock::now() - begin;
 	//RPG::variables[50] = diff.count() / 1000;
+	return CommandError::none;
+}
+
+CommandError cmd_find_path_queued(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 6)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto x = Param::get_integer(params[1]);
+	auto y = Param::get_integer(params[2]);
+	auto readySwitch = Param::get_integer(params[3]);
+	auto outTicket = Param::get_variable(params[4]);
+	auto outSuccess = Param::get_switch(params[5]);
+	if (auto error = check_args(x, y, readySwitch, outTicket, outSuccess); error != CommandError::none)
+		return error;
+
+	Param::set_switch(params[5], false);
+	if (auto target = Param::get_character(params[0]))
+	{
+		// resetting the ready switch may grow the switches
+		Param::set_variable(params[4], globalScheduler.enqueue(*target, { *x, *y }, *readySwitch));
+		Param::set_switch(params[5], true);
+	}
+	return CommandError::none;
+}
+
+CommandError cmd_get_ticket_result(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto ticket = Param::get_integer(params[0]);
+	auto outId = Param::get_variable(params[1]);
+	auto outSuccess = Param::get_switch(params[2]);
+	if (auto error = check_args(ticket, outId, outSuccess); error != CommandError::none)
+		return error;
+
+	*outSuccess = false;
+	auto result = globalScheduler.take_result(*ticket);
+	if (result.state == TicketState::finished && result.pathId)
+	{
+		*outId = *result.pathId;
+		*outSuccess = true;
+	}
+	return CommandError::none;
+}
+
+enum class PollState
+{
+	unknown = 0,
+	pending = 1,
+	found = 2,
+	failed = 3
+};
+
+// like get_ticket_result, but distinguishes pending tickets from failed ones
+CommandError cmd_poll(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2 && _args.parametersCount != 3)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto ticket = Param::get_integer(params[0]);
+	auto outState = Param::get_variable(params[1]);
+	int ignoredId = 0;
+	auto outId = _args.parametersCount == 3 ? Param::get_variable(params[2]) : &ignoredId;
+	if (auto error = check_args(ticket, outState, outId); error != CommandError::none)
+		return error;
+
+	auto result = globalScheduler.take_result(*ticket);
+	switch (result.state)
+	{
+	case TicketState::pending:
+		Param::set_variable(params[1], static_cast<int>(PollState::pending));
+		break;
+	case TicketState::finished:
+		Param::set_variable(params[1], static_cast<int>(result.pathId ? PollState::found : PollState::failed));
+		if (result.pathId && _args.parametersCount == 3)
+			Param::set_variable(params[2], *result.pathId);
+		break;
+	default:
+		Param::set_variable(params[1], static_cast<int>(PollState::unknown));
+	}
+	return CommandError::none;
 }
 
-void cmd_get_path_length(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_cancel_ticket(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 3)
-		throw ParamError("cmd_get_path_length: Invalid param count.");
+	if (_args.parametersCount != 1 && _args.parametersCount != 2)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto& outSuccess = RPGSwitch::get(Param::get_integer(params[2]).value());
-	outSuccess = false;
+	auto& params = _args.parameters;
+	auto ticket = Param::get_integer(params[0]);
+	bool ignoredSuccess = false;
+	auto outSuccess = _args.parametersCount == 2 ? Param::get_switch(params[1]) : &ignoredSuccess;
+	if (auto error = check_args(ticket, outSuccess); error != CommandError::none)
+		return error;
+
+	*outSuccess = globalScheduler.cancel(*ticket);
+	return CommandError::none;
+}
+
+CommandError cmd_get_path_length(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto outLength = Param::get_variable(params[1]);
+	auto outSuccess = Param::get_switch(params[2]);
+	if (auto error = check_args(id, outLength, outSuccess); error != CommandError::none)
+		return error;
+
+	*outSuccess = false;
+	if (auto pathPtr = globalPathMgr.find_path(*id))
+	{
+		*outLength = static_cast<int>(pathPtr->size());
+		*outSuccess = true;
+	}
+	return CommandError::none;
+}
 
-	auto id = Param::get_integer(params[0]).value();
-	auto& outLength = RPGVariable::get(Param::get_integer(params[1]).value());
+CommandError cmd_get_path_vertex(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 5)
+		return CommandError::paramCount;
 	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto index = Param::get_integer(params[1]);
+	auto outX = Param::get_variable(params[2]);
+	auto outY = Param::get_variable(params[3]);
+	auto outSuccess = Param::get_switch(params[4]);
+	if (auto error = check_args(id, index, outX, outY, outSuccess); error != CommandError::none)
+		return error;
 
-	if (auto pathPtr = globalPathMgr.find_path(id))
+	if (auto vertex = 0 <= *index ? globalPathMgr.get_vertex(*id, static_cast<std::size_t>(*index)) : std::nullopt)
 	{
-		outLength = std::size(*pathPtr);
-		outSuccess = true;
+		Param::set_variable(params[2], vertex->x);
+		Param::set_variable(params[3], vertex->y);
+		Param::set_switch(params[4], true);
 	}
+	else
+		Param::set_switch(params[4], false);
+	return CommandError::none;
 }
 
-void cmd_get_path_vertex(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_path_next(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 5)
-		throw ParamError("cmd_get_path_vertex: Invalid param count.");
+	if (_args.parametersCount != 6)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto id = Param::get_integer(params[0]).value();
-	auto index = Param::get_integer(params[1]).value();
-	auto& outX = RPGVariable::get(Param::get_integer(params[2]).value());
-	auto& outY = RPGVariable::get(Param::get_integer(params[3]).value());
-	auto& outSuccess = RPGSwitch::get(Param::get_integer(params[4]).value());
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto outDirection = Param::get_variable(params[1]);
+	auto outX = Param::get_variable(params[2]);
+	auto outY = Param::get_variable(params[3]);
+	auto outFinished = Param::get_switch(params[4]);
+	auto outSuccess = Param::get_switch(params[5]);
+	if (auto error = check_args(id, outDirection, outX, outY, outFinished, outSuccess); error != CommandError::none)
+		return error;
 
-	if (auto pathPtr = globalPathMgr.find_path(id))
+	if (auto step = globalPathMgr.next_step(*id))
 	{
-		auto& path = *pathPtr;
-		auto vertex = path[static_cast<std::size_t>(index)];
-		outX = vertex.x;
-		outY = vertex.y;
-		outSuccess = true;
+		Param::set_variable(params[1], step->direction);
+		Param::set_variable(params[2], step->at.x);
+		Param::set_variable(params[3], step->at.y);
+		Param::set_switch(params[4], step->finished);
+		Param::set_switch(params[5], true);
 	}
 	else
-		outSuccess = false;
+	{
+		Param::set_switch(params[4], true);
+		Param::set_switch(params[5], false);
+	}
+	return CommandError::none;
+}
+
+enum class ExportMode
+{
+	directions = 0,
+	coordinates = 1
+};
+
+CommandError cmd_export_path(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 4 && _args.parametersCount != 5)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto firstVar = Param::get_integer(params[1]);
+	auto maxSteps = Param::get_integer(params[2]);
+	auto outCount = Param::get_variable(params[3]);
+	auto mode = _args.parametersCount == 5 ? Param::get_integer(params[4]) : static_cast<int>(ExportMode::directions);
+	if (auto error = check_args(id, firstVar, maxSteps, outCount, mode); error != CommandError::none)
+		return error;
+	if (*mode != static_cast<int>(ExportMode::directions) && *mode != static_cast<int>(ExportMode::coordinates))
+		return CommandError::invalidParam;
+	if (*firstVar <= 0)
+		return CommandError::invalidVariable;
+
+	auto pathPtr = globalPathMgr.find_path(*id);
+	if (!pathPtr)
+	{
+		*outCount = -1;
+		return CommandError::none;
+	}
+
+	auto count = static_cast<int>(pathPtr->size()) - 1;
+	if (0 <= *maxSteps && *maxSteps < count)
+		count = *maxSteps;
+
+	auto coordinates = static_cast<ExportMode>(*mode) == ExportMode::coordinates;
+	if (auto out = RPGVariable::get_range(*firstVar, count * (coordinates ? 2 : 1)))
+	{
+		auto cursor = pathPtr->begin();
+		for (int i = 0; i < count && pathPtr->advance(cursor); ++i)
+		{
+			if (coordinates)
+			{
+				*out++ = cursor.at.x;
+				*out++ = cursor.at.y;
+			}
+			else
+				*out++ = cursor.dir;
+		}
+	}
+	// the range may have grown the variables, thus the pointer taken before might be dangling now
+	*Param::get_variable(params[3]) = count;
+	return CommandError::none;
+}
+
+// the move commands share their order with RPG::Direction, thus each step translates into exactly one command
+std::string make_move_commands(const CompactPath& _path)
+{
+	std::string moves;
+	moves.reserve(std::size(_path));
+	auto cursor = _path.begin();
+	while (_path.advance(cursor))
+		moves += static_cast<char>(RPG::MT_MOVE_UP + cursor.dir);
+	return moves;
+}
+
+CommandError cmd_apply_path(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2 && _args.parametersCount != 3)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	bool ignoredSuccess = false;
+	auto outSuccess = _args.parametersCount == 3 ? Param::get_switch(params[2]) : &ignoredSuccess;
+	if (auto error = check_args(id, outSuccess); error != CommandError::none)
+		return error;
+
+	*outSuccess = false;
+	auto target = Param::get_character(params[1]);
+	auto pathPtr = globalPathMgr.find_path(*id);
+	// a path which doesn't start at the character's position would lead it anywhere else
+	if (target && pathPtr && 1 < std::size(*pathPtr) && pathPtr->start() == Vector{ target->x, target->y })
+	{
+		auto moves = make_move_commands(*pathPtr);
+		// blocked steps have to be retried instead of skipped, otherwise the character leaves the path
+		target->move(moves.data(), static_cast<int>(std::size(moves)), false, false, target->frequency);
+		*outSuccess = true;
+	}
+	return CommandError::none;
+}
+
+CommandError cmd_follow_path(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 3 && _args.parametersCount != 4)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto finishedSwitch = Param::get_integer(params[2]);
+	bool ignoredSuccess = false;
+	auto outSuccess = _args.parametersCount == 4 ? Param::get_switch(params[3]) : &ignoredSuccess;
+	if (auto error = check_args(id, finishedSwitch, outSuccess); error != CommandError::none)
+		return error;
+
+	auto attached = false;
+	if (auto target = Param::get_character(params[1]))
+		attached = globalFollowers.attach(*target, *id, *finishedSwitch);
+	// attaching resets the finished switch, which may grow the switches
+	if (_args.parametersCount == 4)
+		Param::set_switch(params[3], attached);
+	return CommandError::none;
+}
+
+CommandError cmd_stop_following(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 1)
+		return CommandError::paramCount;
+	
+	if (auto target = Param::get_character(_args.parameters[0]))
+		globalFollowers.detach(*target);
+	return CommandError::none;
+}
+
+CommandError cmd_set_path_owner(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto eventId = Param::get_integer(params[1]);
+	auto outSuccess = Param::get_switch(params[2]);
+	if (auto error = check_args(id, eventId, outSuccess); error != CommandError::none)
+		return error;
+
+	*outSuccess = globalPathMgr.set_owner(*id, *eventId);
+	return CommandError::none;
+}
+
+CommandError cmd_set_path_group(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto groupId = Param::get_integer(params[1]);
+	auto outSuccess = Param::get_switch(params[2]);
+	if (auto error = check_args(id, groupId, outSuccess); error != CommandError::none)
+		return error;
+
+	*outSuccess = globalPathMgr.set_group(*id, *groupId);
+	return CommandError::none;
+}
+
+/* The walker is moved only once the character has arrived at the target of its previous step, thus blocked steps are
+ * simply issued again with the next call. Characters which have left their path are skipped, otherwise they would follow
+ * it with an offset. */
+bool step_character(int _id, RPG::Character& _character)
+{
+	auto path = globalPathMgr.share_path(_id);
+	auto walker = globalPathMgr.get_walker(_id);
+	if (!path || !walker || 0 < _character.movementFramesLeft)
+		return false;
+
+	Vector pos{ _character.x, _character.y };
+	auto next = *walker;
+	if (!path->advance(next))
+		return false;
+
+	if (next.at == pos)
+	{
+		// the path might be released here, if it has an owner; the shared pointer keeps it alive until we are done
+		if (!globalPathMgr.next_step(_id))
+			return false;
+		walker = next;
+		if (!path->advance(next))
+			return false;
+	}
+
+	if (walker->at != pos)
+		return false;
+	_character.doStep(static_cast<RPG::Direction>(next.dir));
+	return true;
 }
 
-void cmd_clear_path(const char* _text, const RPG::ParsedCommentData* _parsedData)
+/* Without a variable block, each character of the group which stands still takes its next step. Otherwise nobody is moved;
+ * the direction of each event's next step is written to the variable (first + event ID - 1) instead, -1 if its path is finished. */
+CommandError cmd_step_group(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 1)
-		throw ParamError("cmd_clear_path: Invalid param count.");
+	if (_args.parametersCount < 1 || 3 < _args.parametersCount)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto id = Param::get_integer(params[0]).value();
+	auto& params = _args.parameters;
+	auto groupId = Param::get_integer(params[0]);
+	auto firstVar = 2 <= _args.parametersCount ? Param::get_integer(params[1]) : 0;
+	int ignoredCount = 0;
+	auto outCount = _args.parametersCount == 3 ? Param::get_variable(params[2]) : &ignoredCount;
+	if (auto error = check_args(groupId, firstVar, outCount); error != CommandError::none)
+		return error;
+	if (*firstVar < 0)
+		return CommandError::invalidVariable;
 
-	globalPathMgr.clear_path(id);
+	int count = 0;
+	globalPathMgr.for_each_in_group(*groupId, [firstVar = *firstVar, &count](int _id, RPG::Character* _character)
+	{
+		if (firstVar == 0)
+		{
+			count += _character && step_character(_id, *_character) ? 1 : 0;
+			return;
+		}
+
+		auto eventId = to_character_code(_character);
+		if (auto out = 0 < eventId ? RPGVariable::get_ptr(firstVar + eventId - 1) : nullptr)
+		{
+			auto step = globalPathMgr.next_step(_id);
+			*out = step ? step->direction : -1;
+			count += step ? 1 : 0;
+		}
+	});
+
+	// the variable block may have grown the variables, thus the pointer taken before might be dangling now
+	if (_args.parametersCount == 3)
+		outCount = Param::get_variable(params[2]);
+	*outCount = count;
+	return CommandError::none;
 }
 
-void cmd_set_terrain_cost(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_get_path_stats(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 2)
-		throw ParamError("cmd_set_terrain_cost: Invalid param count.");
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto id = Param::get_integer(params[0]).value();
-	auto cost = Param::get_integer(params[1]).value();
+	auto& params = _args.parameters;
+	auto outCount = Param::get_variable(params[0]);
+	auto outMemory = Param::get_variable(params[1]);
+	auto outEvictions = Param::get_variable(params[2]);
+	if (auto error = check_args(outCount, outMemory, outEvictions); error != CommandError::none)
+		return error;
 
-	globalCostCalculator.set_cost(id, cost);
+	auto stats = globalPathMgr.stats();
+	Param::set_variable(params[0], static_cast<int>(stats.count));
+	Param::set_variable(params[1], static_cast<int>(stats.memorySize));
+	Param::set_variable(params[2], static_cast<int>(stats.evictions));
+	return CommandError::none;
 }
 
-void cmd_set_terrain_cost_var(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_validate_path(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 2)
-		throw ParamError("cmd_set_terrain_cost_var: Invalid param count.");
+	if (_args.parametersCount != 3 && _args.parametersCount != 4)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto id = Param::get_integer(params[0]).value();
-	auto var = Param::get_integer(params[1]).value();
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto lookahead = Param::get_integer(params[1]);
+	auto outValid = Param::get_switch(params[2]);
+	auto repairWindow = _args.parametersCount == 4 ? Param::get_integer(params[3]) : 0;
+	if (auto error = check_args(id, lookahead, outValid, repairWindow); error != CommandError::none)
+		return error;
 
-	globalCostCalculator.set_cost_var(id, var);
+	*outValid = false;
+	auto path = globalPathMgr.share_path(*id);
+	auto character = globalPathMgr.find_character(*id);
+	if (!path || !character || *lookahead < 0)
+		return CommandError::none;
+
+	auto snapshot = globalSnapshotProvider.get(*character);
+	auto invalidStep = find_invalid_step(*snapshot, *path, *globalPathMgr.get_walker(*id), static_cast<std::size_t>(*lookahead));
+	if (!invalidStep)
+		*outValid = true;
+	else if (0 < *repairWindow)
+	{
+		if (auto repairedPath = repair_step(*snapshot, *path, *invalidStep, static_cast<std::size_t>(*repairWindow)))
+			*outValid = globalPathMgr.replace_path(*id, std::make_shared<const CompactPath>(*repairedPath));
+	}
+	return CommandError::none;
 }
 
-void cmd_get_terrain_cost(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_clear_path(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 2)
-		throw ParamError("cmd_get_terrain_cost: Invalid param count.");
+	if (_args.parametersCount != 1)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto id = Param::get_integer(params[0]).value();
-	auto& outCost = RPGVariable::get(Param::get_integer(params[1]).value());
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	if (auto error = check_args(id); error != CommandError::none)
+		return error;
 
-	outCost = globalCostCalculator.get_cost(id);
+	globalPathMgr.clear_path(*id);
+	return CommandError::none;
 }
 
-void cmd_reset_terrain_cost(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_get_cache_stats(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 1)
-		throw ParamError("cmd_reset_terrain_cost: Invalid param count.");
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto id = Param::get_integer(params[0]).value();
+	auto& params = _args.parameters;
+	auto outHits = Param::get_variable(params[0]);
+	auto outMisses = Param::get_variable(params[1]);
+	if (auto error = check_args(outHits, outMisses); error != CommandError::none)
+		return error;
 
-	globalCostCalculator.reset_cost(id);
+	Param::set_variable(params[0], globalPathCache.hits());
+	Param::set_variable(params[1], globalPathCache.misses());
+	return CommandError::none;
 }
 
-void cmd_clear_terrain_costs(const char* _text, const RPG::ParsedCommentData* _parsedData)
+// the error is reset by this call, thus each failure is reported only once
+CommandError cmd_get_last_error(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 1)
+		return CommandError::paramCount;
+	
+	auto outError = Param::get_variable(_args.parameters[0]);
+	if (auto error = check_args(outError); error != CommandError::none)
+		return error;
+
+	*outError = static_cast<int>(globalLastError);
+	globalLastError = CommandError::none;
+	return CommandError::none;
+}
+
+CommandError cmd_register_hotspot(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto x = Param::get_integer(params[0]);
+	auto y = Param::get_integer(params[1]);
+	if (auto error = check_args(x, y); error != CommandError::none)
+		return error;
+
+	globalHotspots.register_hotspot(RPG::Map::properties->id, { *x, *y });
+	globalHotspots.prepare(*RPG::hero, { *x, *y });
+	return CommandError::none;
+}
+
+CommandError cmd_unregister_hotspot(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto x = Param::get_integer(params[0]);
+	auto y = Param::get_integer(params[1]);
+	if (auto error = check_args(x, y); error != CommandError::none)
+		return error;
+
+	globalHotspots.unregister_hotspot(RPG::Map::properties->id, { *x, *y });
+	return CommandError::none;
+}
+
+CommandError cmd_set_terrain_cost(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto cost = Param::get_integer(params[1]);
+	if (auto error = check_args(id, cost); error != CommandError::none)
+		return error;
+
+	globalCostCalculator.set_cost(*id, *cost);
+	return CommandError::none;
+}
+
+CommandError cmd_set_terrain_cost_var(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto var = Param::get_integer(params[1]);
+	if (auto error = check_args(id, var); error != CommandError::none)
+		return error;
+
+	globalCostCalculator.set_cost_var(*id, *var);
+	return CommandError::none;
+}
+
+CommandError cmd_get_terrain_cost(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	auto outCost = Param::get_variable(params[1]);
+	if (auto error = check_args(id, outCost); error != CommandError::none)
+		return error;
+
+	*outCost = globalCostCalculator.get_cost(*id);
+	return CommandError::none;
+}
+
+CommandError cmd_reset_terrain_cost(const char* _text, const CommandArgs& _args)
+{
+	if (_args.parametersCount != 1)
+		return CommandError::paramCount;
+	
+	auto& params = _args.parameters;
+	auto id = Param::get_integer(params[0]);
+	if (auto error = check_args(id); error != CommandError::none)
+		return error;
+
+	globalCostCalculator.reset_cost(*id);
+	return CommandError::none;
+}
+
+CommandError cmd_clear_terrain_costs(const char* _text, const CommandArgs& _args)
 {
-	auto& params = _parsedData->parameters;
 	globalCostCalculator.clear();
+	return CommandError::none;
 }
 
-void cmd_set_terrain_travel_cost(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_set_terrain_travel_cost(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 3)
-		throw ParamError("cmd_set_terrain_travel_cost: Invalid param count.");
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto fromId = Param::get_integer(params[0]).value();
-	auto toId = Param::get_integer(params[1]).value();
-	auto cost = Param::get_integer(params[2]).value();
+	auto& params = _args.parameters;
+	auto fromId = Param::get_integer(params[0]);
+	auto toId = Param::get_integer(params[1]);
+	auto cost = Param::get_integer(params[2]);
+	if (auto error = check_args(fromId, toId, cost); error != CommandError::none)
+		return error;
 
-	globalEdgeCostCalculator.set_cost(fromId, toId, cost);
+	globalEdgeCostCalculator.set_cost(*fromId, *toId, *cost);
+	return CommandError::none;
 }
 
-void cmd_set_terrain_travel_cost_var(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_set_terrain_travel_cost_var(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 3)
-		throw ParamError("cmd_set_terrain_travel_cost_var: Invalid param count.");
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto fromId = Param::get_integer(params[0]).value();
-	auto toId = Param::get_integer(params[1]).value();
-	auto var = Param::get_integer(params[2]).value();
+	auto& params = _args.parameters;
+	auto fromId = Param::get_integer(params[0]);
+	auto toId = Param::get_integer(params[1]);
+	auto var = Param::get_integer(params[2]);
+	if (auto error = check_args(fromId, toId, var); error != CommandError::none)
+		return error;
 
-	globalEdgeCostCalculator.set_cost_var(fromId, toId, var);
+	globalEdgeCostCalculator.set_cost_var(*fromId, *toId, *var);
+	return CommandError::none;
 }
 
-void cmd_get_terrain_travel_cost(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_get_terrain_travel_cost(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 3)
-		throw ParamError("cmd_get_terrain_travel_cost: Invalid param count.");
+	if (_args.parametersCount != 3)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto fromId = Param::get_integer(params[0]).value();
-	auto toId = Param::get_integer(params[1]).value();
-	auto& outCost = RPGVariable::get(Param::get_integer(params[2]).value());
+	auto& params = _args.parameters;
+	auto fromId = Param::get_integer(params[0]);
+	auto toId = Param::get_integer(params[1]);
+	auto outCost = Param::get_variable(params[2]);
+	if (auto error = check_args(fromId, toId, outCost); error != CommandError::none)
+		return error;
 
-	outCost = globalEdgeCostCalculator.get_cost(fromId, toId);
+	*outCost = globalEdgeCostCalculator.get_cost(*fromId, *toId);
+	return CommandError::none;
 }
 
-void cmd_reset_terrain_travel_cost(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_reset_terrain_travel_cost(const char* _text, const CommandArgs& _args)
 {
-	if (_parsedData->parametersCount != 2)
-		throw ParamError("cmd_reset_terrain_travel_cost: Invalid param count.");
+	if (_args.parametersCount != 2)
+		return CommandError::paramCount;
 	
-	auto& params = _parsedData->parameters;
-	auto fromId = Param::get_integer(params[0]).value();
-	auto toId = Param::get_integer(params[1]).value();
+	auto& params = _args.parameters;
+	auto fromId = Param::get_integer(params[0]);
+	auto toId = Param::get_integer(params[1]);
+	if (auto error = check_args(fromId, toId); error != CommandError::none)
+		return error;
 
-	globalEdgeCostCalculator.reset_cost(fromId, toId);
+	globalEdgeCostCalculator.reset_cost(*fromId, *toId);
+	return CommandError::none;
 }
 
-void cmd_clear_terrain_travel_costs(const char* _text, const RPG::ParsedCommentData* _parsedData)
+CommandError cmd_clear_terrain_travel_costs(const char* _text, const CommandArgs& _args)
 {
-	auto& params = _parsedData->parameters;
 	globalEdgeCostCalculator.clear();
+	return CommandError::none;
 }
 
-bool onComment(const char* _text, const RPG::ParsedCommentData* _parsedData, RPG::EventScriptLine* _nextScriptLine,
-	RPG::EventScriptData* _scriptData, int _eventId, int _pageId, int _lineId, int* _nextLineId)
+using CommandPtr = std::add_pointer<CommandError(const char*, const CommandArgs&)>::type;
+
+/* The command names are hashed into a table at compile time. The seed of the hash is searched until every name gets a slot
+ * on its own, thus a lookup costs one hash and one comparison. Comments of other plugins are usually rejected by the prefix.
+ * Names are compared case insensitive, because commands within a batch are plain tokens. */
+namespace command_table
 {
-	using CommandPtr = std::add_pointer<void(const char*, const RPG::ParsedCommentData*)>::type;
-	static const std::unordered_map<std::string_view, CommandPtr> commands
+	struct Entry
 	{
-		{ "pathfeeder_find_path",					&::cmd_find_path },
-		{ "pathfeeder_get_path_length",				&::cmd_get_path_length },
-		{ "pathfeeder_get_path_vertex",				&::cmd_get_path_vertex },
-		{ "pathfeeder_clear_path",					&::cmd_clear_path },
+		std::string_view name;		// without prefix
+		CommandPtr command = nullptr;
+	};
+
+	constexpr std::string_view prefix = "pathfeeder_";
+	constexpr std::size_t slotCount = 128;
+
+	constexpr Entry entries[] =
+	{
+		{ "find_path",							&::cmd_find_path },
+		{ "find_path_queued",					&::cmd_find_path_queued },
+		{ "get_ticket_result",					&::cmd_get_ticket_result },
+		{ "poll",								&::cmd_poll },
+		{ "cancel_ticket",						&::cmd_cancel_ticket },
+		{ "get_cache_stats",					&::cmd_get_cache_stats },
+		{ "get_last_error",						&::cmd_get_last_error },
+		{ "register_hotspot",					&::cmd_register_hotspot },
+		{ "unregister_hotspot",					&::cmd_unregister_hotspot },
+		{ "get_path_length",					&::cmd_get_path_length },
+		{ "get_path_vertex",					&::cmd_get_path_vertex },
+		{ "path_next",							&::cmd_path_next },
+		{ "export_path",						&::cmd_export_path },
+		{ "apply_path",							&::cmd_apply_path },
+		{ "follow_path",						&::cmd_follow_path },
+		{ "stop_following",						&::cmd_stop_following },
+		{ "set_path_owner",						&::cmd_set_path_owner },
+		{ "set_path_group",						&::cmd_set_path_group },
+		{ "step_group",							&::cmd_step_group },
+		{ "get_path_stats",						&::cmd_get_path_stats },
+		{ "validate_path",						&::cmd_validate_path },
+		{ "clear_path",							&::cmd_clear_path },
 		
-		{ "pathfeeder_set_terrain_cost",			&::cmd_set_terrain_cost },
-		{ "pathfeeder_set_terrain_cost_var",		&::cmd_set_terrain_cost_var },
-		{ "pathfeeder_reset_terrain_cost",			&::cmd_reset_terrain_cost },
-		{ "pathfeeder_get_terrain_cost",			&::cmd_get_terrain_cost },
-		{ "pathfeeder_clear_terrain_costs",			&::cmd_clear_terrain_costs },
+		{ "set_terrain_cost",					&::cmd_set_terrain_cost },
+		{ "set_terrain_cost_var",				&::cmd_set_terrain_cost_var },
+		{ "reset_terrain_cost",					&::cmd_reset_terrain_cost },
+		{ "get_terrain_cost",					&::cmd_get_terrain_cost },
+		{ "clear_terrain_costs",				&::cmd_clear_terrain_costs },
 		
-		{ "pathfeeder_set_terrain_travel_cost",		&::cmd_set_terrain_travel_cost },
-		{ "pathfeeder_set_terrain_travel_cost_var",	&::cmd_set_terrain_travel_cost_var },
-		{ "pathfeeder_reset_terrain_travel_cost",	&::cmd_reset_terrain_travel_cost },
-		{ "pathfeeder_get_terrain_travel_cost",		&::cmd_get_terrain_travel_cost },
-		{ "pathfeeder_clear_terrain_travel_costs",	&::cmd_clear_terrain_travel_costs }
+		{ "set_terrain_travel_cost",			&::cmd_set_terrain_travel_cost },
+		{ "set_terrain_travel_cost_var",		&::cmd_set_terrain_travel_cost_var },
+		{ "reset_terrain_travel_cost",			&::cmd_reset_terrain_travel_cost },
+		{ "get_terrain_travel_cost",			&::cmd_get_terrain_travel_cost },
+		{ "clear_terrain_travel_costs",			&::cmd_clear_terrain_travel_costs }
 	};
-	
-	std::string_view cmdStr{ _parsedData->command };
-	if (const auto itr = commands.find(cmdStr); itr != std::end(commands))
+
+	constexpr std::size_t slot_of(std::string_view _name, std::uint32_t _seed)
 	{
-		try
+		// FNV-1a
+		std::uint32_t hash = 2166136261u ^ _seed;
+		for (auto c : _name)
+			hash = (hash ^ static_cast<unsigned char>(Param::to_lower(c))) * 16777619u;
+		// the low bits of FNV-1a depend on the low bits of the seed only, thus everything is mixed down again
+		hash ^= hash >> 16;
+		hash *= 0x45d9f3bu;
+		hash ^= hash >> 16;
+		return hash % slotCount;
+	}
+
+	constexpr bool is_perfect(std::uint32_t _seed)
+	{
+		bool used[slotCount]{};
+		for (auto& entry : entries)
 		{
-			itr->second(_text, _parsedData);
+			auto slot = slot_of(entry.name, _seed);
+			if (used[slot])
+				return false;
+			used[slot] = true;
 		}
-		catch (const ParamError&)
+		return true;
+	}
+
+	constexpr std::uint32_t find_seed()
+	{
+		std::uint32_t seed = 0;
+		while (!is_perfect(seed))
+			++seed;
+		return seed;
+	}
+
+	constexpr std::uint32_t seed = find_seed();
+
+	constexpr std::array<Entry, slotCount> build_slots()
+	{
+		std::array<Entry, slotCount> slots{};
+		for (auto& entry : entries)
+			slots[slot_of(entry.name, seed)] = entry;
+		return slots;
+	}
+
+	constexpr std::array<Entry, slotCount> slots = build_slots();
+
+	// expects the name without prefix
+	constexpr CommandPtr find_name(std::string_view _name)
+	{
+		auto& entry = slots[slot_of(_name, seed)];
+		return Param::equals_ignore_case(_name, entry.name) ? entry.command : nullptr;
+	}
+
+	constexpr bool has_prefix(std::string_view _command)
+	{
+		return std::size(prefix) < std::size(_command) && Param::equals_ignore_case(_command.substr(0, std::size(prefix)), prefix);
+	}
+
+	constexpr CommandPtr find(std::string_view _command)
+	{
+		return has_prefix(_command) ? find_name(_command.substr(std::size(prefix))) : nullptr;
+	}
+
+	static_assert(find("pathfeeder_find_path") == &::cmd_find_path);
+	static_assert(find("pathfeeder_clear_terrain_travel_costs") == &::cmd_clear_terrain_travel_costs);
+	static_assert(find_name("Get_Path_Vertex") == &::cmd_get_path_vertex);
+	static_assert(find("PathFeeder_Find_Path") == &::cmd_find_path);
+	static_assert(find("pathfeeder_") == nullptr && find("other_find_path") == nullptr && find_name("batch") == nullptr);
+}
+
+struct CompiledCommand
+{
+	CommandPtr command = nullptr;
+	int firstParameter = 0;
+	int parametersCount = 0;
+	std::array<ParamKind, Param::maxCompiledParams> kinds{};
+};
+
+struct CompiledComment
+{
+	std::string text;		// the whole comment; RPG_RT may reuse its buffer, thus the address alone proves nothing
+	int parametersCount = 0;
+	CommandError error = CommandError::none;		// set, if a batch is malformed; none of its commands will be executed then
+	std::vector<CompiledCommand> commands;		// empty for comments of other plugins
+
+	bool is_ours() const
+	{
+		return error != CommandError::none || !std::empty(commands);
+	}
+};
+
+constexpr std::string_view batchCommand = "pathfeeder_batch";
+
+CompiledCommand compile_command(CommandPtr _command, const RPG::ParsedCommentParameter* _params, int _first, int _count)
+{
+	CompiledCommand command{ _command, _first, _count };
+	for (int i = 0; i < _count && i < static_cast<int>(Param::maxCompiledParams); ++i)
+		command.kinds[i] = Param::classify(_params[_first + i]);
+	return command;
+}
+
+// within a batch, each token which names a command starts the next command
+CommandPtr find_batch_command(const RPG::ParsedCommentParameter& _param)
+{
+	return _param.type == RPG::PARAM_TOKEN ? command_table::find_name(Param::token_of(_param)) : nullptr;
+}
+
+/* "@pathfeeder_batch set_terrain_cost, 1, 5, set_terrain_cost, 2, 10" is split into its commands once; they are executed
+ * back to back afterwards. */
+CompiledComment compile_comment(const char* _text, const RPG::ParsedCommentData& _parsedData)
+{
+	CompiledComment comment;
+	comment.text = _text;
+	comment.parametersCount = _parsedData.parametersCount;
+
+	std::string_view name{ _parsedData.command };
+	if (!Param::equals_ignore_case(name, batchCommand))
+	{
+		if (auto command = command_table::find(name))
+			comment.commands.emplace_back(compile_command(command, _parsedData.parameters, 0, _parsedData.parametersCount));
+		return comment;
+	}
+
+	if (_parsedData.parametersCount <= 0)
+		comment.error = CommandError::paramCount;
+	for (int i = 0; i < _parsedData.parametersCount;)
+	{
+		auto command = find_batch_command(_parsedData.parameters[i]);
+		if (!command)
 		{
+			comment.error = CommandError::invalidParam;
+			comment.commands.clear();
+			break;
 		}
-		return false;
+
+		auto first = ++i;
+		while (i < _parsedData.parametersCount && !find_batch_command(_parsedData.parameters[i]))
+			++i;
+		comment.commands.emplace_back(compile_command(command, _parsedData.parameters, first, i - first));
 	}
-	return true;
+	return comment;
 }
 
-bool onEventCommand(RPG::EventScriptLine* _scriptLine, RPG::EventScriptData* _scriptData, int _eventId, int _pageId, int _lineId, int* _nextLineId)
+/* Decoded comments per (event, page, line). The key is ambiguous, as battle events and common events all use event or
+ * page 0, thus an entry is only reused if its comment text matches; otherwise the line is compiled again. Event IDs refer
+ * to the current map, thus everything is forgotten when the map changes. */
+class CommandCache
 {
-	switch (_scriptLine->command)
+public:
+	const CompiledComment* find(int _eventId, int _pageId, int _lineId, const char* _text, int _parametersCount)
+	{
+		_sync_map_epoch();
+		if (auto itr = m_Comments.find(Key{ _eventId, _pageId, _lineId }); itr != std::end(m_Comments) &&
+			itr->second.parametersCount == _parametersCount && itr->second.text == _text)
+			return &itr->second;
+		return nullptr;
+	}
+
+	const CompiledComment& insert(int _eventId, int _pageId, int _lineId, CompiledComment _comment)
+	{
+		return m_Comments.insert_or_assign(Key{ _eventId, _pageId, _lineId }, std::move(_comment)).first->second;
+	}
+
+private:
+	struct Key
+	{
+		int eventId;
+		int pageId;
+		int lineId;
+
+		bool operator ==(const Key& _other) const
+		{
+			return eventId == _other.eventId && pageId == _other.pageId && lineId == _other.lineId;
+		}
+	};
+
+	struct KeyHash
+	{
+		std::size_t operator ()(const Key& _key) const
+		{
+			auto hash = std::hash<int>{}(_key.eventId);
+			hash = hash * 31 + std::hash<int>{}(_key.pageId);
+			return hash * 31 + std::hash<int>{}(_key.lineId);
+		}
+	};
+
+	std::unordered_map<Key, CompiledComment, KeyHash> m_Comments;
+	unsigned int m_MapEpoch = 0;
+
+	void _sync_map_epoch()
 	{
-	case RPG::EVCMD_TELEPORT:
+		if (m_MapEpoch != update_map_epoch())
+		{
+			m_MapEpoch = globalMapEpoch;
+			m_Comments.clear();
+		}
+	}
+};
+
+inline static CommandCache globalCommandCache;
+
+void report_status(CommandError _error)
+{
+	if (_error != CommandError::none)
+		globalLastError = _error;
+	if (auto errorVar = RPGVariable::get_ptr(globalSettings.errorVariable))
+		*errorVar = static_cast<int>(_error);
+	if (auto errorSwitch = RPGSwitch::get_ptr(globalSettings.errorSwitch))
+		*errorSwitch = _error != CommandError::none;
+}
+
+bool onComment(const char* _text, const RPG::ParsedCommentData* _parsedData, RPG::EventScriptLine* _nextScriptLine,
+	RPG::EventScriptData* _scriptData, int _eventId, int _pageId, int _lineId, int* _nextLineId)
+{
+	// comments of other plugins must not cost more than this check
+	if (!command_table::has_prefix(_parsedData->command))
+		return true;
+
+	// the cache also notices when the map has been changed earlier this frame
+	auto compiled = globalCommandCache.find(_eventId, _pageId, _lineId, _text, _parsedData->parametersCount);
+	if (!compiled)
 	{
-		/*
-		 * 0 = mapId
-		 * 1 = x
-		 * 2 = y
-		 * 3 = facing (0 = retain)
-		 */
-		auto& params = _scriptLine->parameters;
-		if (RPG::Map::properties->id != params[0])
-			globalPathMgr.clear();
+		// unknown commands aren't cached; they are most likely typos, which will be fixed anyway
+		auto comment = compile_comment(_text, *_parsedData);
+		if (!comment.is_ours())
+			return true;
+		compiled = &globalCommandCache.insert(_eventId, _pageId, _lineId, std::move(comment));
 	}
-	default: break;
+
+	// the descriptors must not outlive the call
+	struct CompiledParamsScope
+	{
+		CompiledParamsScope(const CompiledCommand& _command, const RPG::ParsedCommentParameter* _params)
+		{
+			Param::compiledKinds = _command.kinds.data();
+			Param::compiledParams = _params;
+		}
+
+		~CompiledParamsScope()
+		{
+			Param::compiledKinds = nullptr;
+			Param::compiledParams = nullptr;
+		}
+	};
+
+	globalPathMgr.restore_pending();
+	// a batch stops at its first failing command
+	auto error = compiled->error;
+	for (auto& command : compiled->commands)
+	{
+		auto params = _parsedData->parameters + command.firstParameter;
+		CompiledParamsScope scope{ command, params };
+		error = command.command(_text, CommandArgs{ params, command.parametersCount });
+		if (error != CommandError::none)
+			break;
 	}
-	return true;
+	report_status(error);
+	return false;
 }
 
-void onLoadGame(int _id, char* _data, int _length)
+void onFrame(RPG::Scene _scene)
 {
-	// thanks to https://stackoverflow.com/a/1449527/4691843
-	struct OneShotReadBuf : public std::streambuf
+	if (_scene != RPG::SCENE_MAP)
+		return;
+
+	// all stages share a single budget; each one gets whatever the previous ones left
+	auto deadline = std::chrono::steady_clock::now() + globalSettings.frameBudget;
+	auto remainingBudget = [deadline]
 	{
-	    OneShotReadBuf(char* s, std::size_t n)
-	    {
-	        setg(s, s, s + n);
-	    }
+		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		return std::max(remaining, std::chrono::microseconds::zero());
 	};
-	OneShotReadBuf buffer(_data, _length);
-	std::istream in(&buffer);
-	in >>globalCostCalculator;
 
-	globalPathMgr.clear();
+	update_map_epoch();
+	globalPathMgr.restore_pending();
+	if (!globalWorkerPool.is_running() && 0 < globalSettings.worker_count())
+		globalWorkerPool.start(globalSettings.worker_count());
+	globalAllPairs.update(globalSettings.allPairsMaxTiles, globalSettings.allPairsMaxBytes, remainingBudget());
+	globalFollowers.update();
+	globalPathMgr.release_outdated();
+	globalScheduler.process(remainingBudget());
+}
+
+void onLoadGame(int _id, char* _data, int _length)
+{
+	// the map id may be the same, but everything else isn't
+	++globalMapEpoch;
+	globalHotspots.clear();
+
+	globalPathMgr.discard_pending();
+	auto size = static_cast<std::size_t>(0 < _length ? _length : 0);
+	if (save_data::is_binary(_data, size))
+		save_data::read(_data, size);
+	else
+		save_data::read_legacy(_data, size);
 }
 
 void onSaveGame(int id, void __cdecl(*savePluginData)(char*data, int length))
 {
-	std::ostringstream out(std::ios_base::out | std::ios_base::binary);
-	out << globalCostCalculator;
-	savePluginData(out.str().data(), std::size(out.str()));
+	auto writer = save_data::write();
+	auto& buffer = writer.buffer();
+	savePluginData(const_cast<char*>(buffer.data()), static_cast<int>(std::size(buffer)));
+}
+
+bool onStartup(char* _pluginName)
+{
+	globalSettings.load(RPG::loadConfiguration(const_cast<char*>("pathfeeder")));
+	globalPathCache.set_capacity(globalSettings.cacheSize);
+	globalPathMgr.set_memory_limit(globalSettings.pathMemoryMaxBytes);
+	return true;
+}
+
+void onExit()
+{
+	globalAllPairs.stop();
+	globalWorkerPool.stop();
 }
 
 void onNewGame()
 {
-	globalCostCalculator.clear();
-	globalPathMgr.clear();
+	++globalMapEpoch;
+	globalEdgeCostCalculator.clear();
+	globalHotspots.clear();
+	globalPathMgr.discard_pending();
 	
+	// negative values refer to variables, which is exactly how they are stored internally
+	std::vector<IdData<CostCalculator::data_type>> costs;
 	for (auto&[key, strValue] : RPG::loadConfiguration(const_cast<char*>("pathfeeder")))	// parameter won't get modified internally; doesn't seem to be non-const on purpose
 	{
 		try
 		{
 			auto id = std::stoi(key);
 			auto value = std::stoi(strValue);
-			if (value < 0)
-				globalCostCalculator.set_cost_var(id, -value);
-			else
-				globalCostCalculator.set_cost(id, value);
+			if (value != 0)
+				costs.emplace_back(id, value);
 		}
-		catch (const std::invalid_argument&)
+		catch (const std::logic_error&)
 		{}
 	}
+	globalCostCalculator.assign(std::move(costs));
 }